@@ -1,20 +1,46 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <thread>
+#include <vector>
 #include <dpp/dpp.h>
 
+#include "choretracker/config.h"
 #include "choretracker/db.h"
+#include "choretracker/dispatcher.h"
+#include "choretracker/partitions.h"
+#include "choretracker/scheduler.h"
 
 class Alerter {
    public:
-      Alerter(Database& db, dpp::cluster& bot) : db(db), bot(bot) {}
+      Alerter(Database& db, dpp::cluster& bot) : db(db), bot(bot), 
+            partitions(db, config_get()->alert_partitions, std::chrono::seconds(config_get()->alert_lease_seconds)),
+            dispatcher(db, bot) {}
 
       void begin();
-      void run_alerts();
+      void stop(std::chrono::seconds timeout);
+      void run_alerts(const std::function<void(size_t done, size_t total)>& progress = nullptr);
+      /// @brief Take requests to run alerts left by processes that don't alert, set before begin()
+      void on_run_requested(std::function<void(const alert_run_request& request)> handler) { run_requested = std::move(handler); }
    private:
       void thread_task();
+      void rebuild_schedule();
+      void alert_scheduled_user(const std::string& user_id);
+      void send_alert(const dpp::snowflake& user_id, const std::vector<task_definition>& user_tasks, std::chrono::sys_days today,
+         const std::optional<std::chrono::year_month_day>& claim_date = {});
 
       Database& db;
       dpp::cluster& bot;
+      PartitionCoordinator partitions;
+      AlertScheduler scheduler;
+      AlertDispatcher dispatcher;
+      std::function<void(const alert_run_request& request)> run_requested;
       std::thread thread;
-};
\ No newline at end of file
+      std::mutex stop_mutex;
+      std::condition_variable stop_cv;
+      bool stopping = false;
+};
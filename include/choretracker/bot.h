@@ -1,21 +1,81 @@
 #pragma once
 
+#include <functional>
+#include <optional>
 #include <dpp/dpp.h>
 
 #include "choretracker/db.h"
 #include "choretracker/alerter.h"
+#include "choretracker/delay_queue.h"
+#include "choretracker/jobs.h"
+#include "choretracker/rate_limit.h"
+#include "choretracker/task_events.h"
+#include "choretracker/write_queue.h"
+
+/// @brief Sends a command's reply back the way the command came in, over the gateway or
+/// in the HTTP interaction response
+/// @param on_sent Called once the reply has gone out, for any follow-up messages
+using command_responder = std::function<void(const dpp::message& message, const std::function<void()>& on_sent)>;
+
+// Discord REST API version interaction webhooks are sent to
+#define DISCORD_API_PATH "/api/v10"
+// Filling in a deferred reply is tried this many times, as Discord reports "Unknown interaction"
+// until it has processed the deferral
+#define DEFERRED_REPLY_ATTEMPTS 5
+// Wait before the first try, doubling for each retry
+#define DEFERRED_REPLY_RETRY_DELAY std::chrono::milliseconds(250)
+
+// Gateway connection settings, shards are spread over processes by cluster id
+struct gateway_options {
+    uint32_t intents = 0;
+    // 0 lets Discord recommend a shard count
+    uint32_t shard_count = 0;
+    // This process runs shards where shard_id % cluster_count == cluster_id
+    uint32_t cluster_id = 0;
+    uint32_t cluster_count = 1;
+};
+
+uint32_t gateway_intents_from_string(const std::string& intents);
+
+// Which parts of the bot this process runs
+struct bot_roles {
+    // Connect to the gateway and take slash commands from it
+    bool gateway = true;
+    // Run the alert scheduler and send alert DMs
+    bool alerting = true;
+};
 
 class Bot {
     public:
-        Bot(const std::string& bot_token, Database& db) : cluster(bot_token), db(db), alerter(db, cluster) {
+        /// @param writer Task writes from commands, null if this process doesn't take commands
+        Bot(const std::string& bot_token, const bot_roles& roles, const gateway_options& gateway, Database& db, TaskEventHub& events, TaskWriter* writer) 
+                : cluster(bot_token, gateway.intents, gateway.shard_count, gateway.cluster_id, gateway.cluster_count), 
+                roles(roles), db(db), events(events), writer(writer), alerter(db, cluster), limiter("bot") {
             init();
         }
 
         void waitForExit();
+        void stop(std::chrono::seconds timeout);
+
+        void handle_command(const dpp::interaction& command, const command_responder& respond);
+        std::optional<dpp::interaction_response> handle_autocomplete(const dpp::interaction& command);
+        void send_deferred_reply(const dpp::snowflake& application_id, const std::string& token, const dpp::message& message,
+            const std::function<void()>& on_sent, int attempt = 1);
     private:
         void init();
+        void count_gateway_events();
+        void run_alerts(const dpp::interaction& command, const command_responder& respond);
+        void start_alert_run(const dpp::snowflake& application_id, const std::string& interaction_token);
+        std::optional<std::chrono::milliseconds> rate_limit(const dpp::snowflake& user_id);
 
         dpp::cluster cluster;
+        bot_roles roles;
         Database& db;
+        TaskEventHub& events;
+        TaskWriter* writer;
         Alerter alerter;
+        RateLimiter limiter;
+        JobExecutor jobs;
+        // Deferred replies waiting to be filled in
+        DelayQueue deferred_replies;
 };
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "choretracker/config.h"
+
+// First bytes of every trace file, bump the digit if the layout changes
+#define TRACE_MAGIC "CHTRACE1"
+// How often buffered records are written out
+#define CAPTURE_FLUSH_INTERVAL std::chrono::seconds(1)
+// Records are dropped rather than buffered past this, so a stalled disk can't eat memory
+#define CAPTURE_BUFFER_BYTES (4 * 1024 * 1024)
+
+// Frame tags in a trace file
+#define TRACE_FRAME_NAME 1
+#define TRACE_FRAME_RECORD 2
+
+enum class trace_kind : uint8_t {
+    http = 1,
+    command = 2,
+    autocomplete = 3,
+    db = 4
+};
+
+/// @brief One captured request, command or DB call
+///
+/// Nothing identifying is kept: users and task names are reduced to hashes salted
+/// per capture, so they only line up with other records in the same trace.
+struct trace_record {
+    trace_kind kind;
+    // Route ("PUT /api/tasks/<name>/complete"), command ("addtask regular") or DB method
+    std::string op;
+    // HTTP status, or 0 for success and 1 for failure
+    uint16_t status = 0;
+    // Anonymized user, 0 if there isn't one
+    uint32_t user = 0;
+    // Anonymized task name, 0 if there isn't one
+    uint32_t object = 0;
+    // When it started, relative to the start of the capture
+    std::chrono::microseconds offset{ 0 };
+    std::chrono::microseconds duration{ 0 };
+    // Response bytes for HTTP, typed characters for autocomplete, options for commands
+    uint32_t size = 0;
+};
+
+/// @brief Start capturing to the configured file, does nothing if capture_file isn't set
+void capture_init(const config_snapshot& config);
+/// @brief Write out anything buffered and close the trace
+void capture_shutdown();
+bool capture_enabled();
+
+/// @brief Salted hash of a user or task name, 0 for an empty value
+uint32_t capture_anonymize(std::string_view value);
+/// @brief Buffer a record, timed from start to now
+void capture_record(trace_kind kind, std::string_view op, std::chrono::steady_clock::time_point start,
+    uint16_t status = 0, uint32_t user = 0, uint32_t object = 0, uint32_t size = 0);
+
+/// @brief Reads records back out of a trace file, in the order they finished
+class TraceReader {
+    public:
+        TraceReader(const std::string& path);
+
+        /// @brief Whether the file opened and has a trace header
+        bool valid() const { return header_valid; }
+        /// @brief Wall clock time the capture started
+        std::chrono::system_clock::time_point started_at() const { return start; }
+        /// @return Next record, or empty at the end of the file or on a truncated frame
+        std::optional<trace_record> next();
+    private:
+        std::ifstream file;
+        bool header_valid = false;
+        std::chrono::system_clock::time_point start;
+        std::vector<std::string> names;
+};
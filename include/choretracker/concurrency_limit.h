@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "choretracker/metrics.h"
+
+// Limit to start from, before any latency has been seen
+#define CONCURRENCY_LIMIT_INITIAL 20
+// Recent latency can rise this far over the long term average before the limit comes down
+#define CONCURRENCY_LIMIT_TOLERANCE 1.5
+// Weight of each sample in the recent latency average
+#define CONCURRENCY_LIMIT_SHORT_WEIGHT 0.1
+// Weight of each sample in the long term average while latency is rising, so a slow DB
+// isn't taken as normal until it has stayed slow for a while. It follows falls at the short weight
+#define CONCURRENCY_LIMIT_LONG_WEIGHT 0.001
+// How far a limit's worth of samples moves the limit towards its new target
+#define CONCURRENCY_LIMIT_SMOOTHING 0.5
+// Share of the limit low priority requests can fill, the rest is kept for everything else
+#define CONCURRENCY_LIMIT_LOW_PRIORITY_SHARE 0.75
+
+enum class request_priority {
+    // Pages, sign in, settings and task writes
+    high,
+    // Listings, stats, export and import, the first to go when the DB is slow
+    low
+};
+
+/// @brief Caps work in flight, with a limit that follows how latency responds to load
+///
+/// Uses a latency gradient: while recent latency stays near its long term average the
+/// limit creeps up, and once requests start queueing behind the DB it drops in
+/// proportion, so excess requests are turned away up front instead of all timing out
+/// together. Bounds are passed on each call so they can follow config reloads.
+class ConcurrencyLimiter {
+    public:
+        /// @param name Label for this limiter's metrics, e.g. "web"
+        ConcurrencyLimiter(const std::string& name);
+
+        /// @brief Take a slot, which must be handed back with release()
+        /// @return Whether there was room
+        bool try_acquire(request_priority priority, int min_limit, int max_limit);
+        /// @brief Hand back a slot
+        /// @param latency Time the work spent waiting on the dependency being protected, if any
+        void release(std::optional<std::chrono::steady_clock::duration> latency, int min_limit, int max_limit);
+    private:
+        void update(double latency_ms, int min_limit, int max_limit);
+
+        std::mutex mutex;
+        double limit = CONCURRENCY_LIMIT_INITIAL;
+        int in_flight = 0;
+        // Averages in milliseconds, zero until the first sample
+        double short_latency_ms = 0;
+        double long_latency_ms = 0;
+
+        Metric& admitted;
+        Metric& shed_high;
+        Metric& shed_low;
+        Metric& limit_gauge;
+        Metric& in_flight_gauge;
+        Metric& latency_gauge;
+};
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <string>
 
+#include "choretracker/utils.hpp"
+
 #define CONFIG_BOT_TOKEN "bot_token"
 #define CONFIG_TEST_GUILD "test_guild"
 #define CONFIG_REGISTER_COMMANDS "register_commands"
@@ -12,8 +15,142 @@
 #define CONFIG_WEB_BASE_URL "web_base_url"
 #define CONFIG_DISCORD_CLIENT_ID "discord_client_id"
 #define CONFIG_DISCORD_CLIENT_SECRET "discord_client_secret"
+#define CONFIG_ALERT_PARTITIONS "alert_partitions"
+#define CONFIG_ALERT_LEASE_SECONDS "alert_lease_seconds"
+#define CONFIG_ALERT_BATCH_SIZE "alert_batch_size"
+#define CONFIG_DM_RATE_PER_SECOND "dm_rate_per_second"
+#define CONFIG_DM_MAX_ATTEMPTS "dm_max_attempts"
+#define CONFIG_SPDLOG_LEVEL "spdlog_level"
+#define CONFIG_SHUTDOWN_DRAIN_SECONDS "shutdown_drain_seconds"
+#define CONFIG_SHUTDOWN_GRACE_SECONDS "shutdown_grace_seconds"
+#define CONFIG_OAUTH_POOL_SIZE "oauth_pool_size"
+#define CONFIG_OAUTH_CONNECT_TIMEOUT_MS "oauth_connect_timeout_ms"
+#define CONFIG_OAUTH_READ_TIMEOUT_MS "oauth_read_timeout_ms"
+#define CONFIG_DB_READ_PREFERENCE "db_read_preference"
+#define CONFIG_DB_POOL_MIN "db_pool_min"
+#define CONFIG_DB_POOL_MAX "db_pool_max"
+#define CONFIG_DB_WAIT_QUEUE_TIMEOUT_MS "db_wait_queue_timeout_ms"
+#define CONFIG_DB_WRITE_CONCERN "db_write_concern"
+#define CONFIG_DB_COORDINATION_WRITE_CONCERN "db_coordination_write_concern"
+#define CONFIG_DB_WRITE_TIMEOUT_MS "db_write_timeout_ms"
+#define CONFIG_GATEWAY_INTENTS "gateway_intents"
+#define CONFIG_GATEWAY_SHARD_COUNT "gateway_shard_count"
+#define CONFIG_GATEWAY_CLUSTER_ID "gateway_cluster_id"
+#define CONFIG_GATEWAY_CLUSTER_COUNT "gateway_cluster_count"
+#define CONFIG_INTERACTIONS_PUBLIC_KEY "interactions_public_key"
+#define CONFIG_WRITE_QUEUE_DIR "write_queue_dir"
+#define CONFIG_LOG_ASYNC "log_async"
+#define CONFIG_LOG_QUEUE_SIZE "log_queue_size"
+#define CONFIG_LOG_OVERFLOW_POLICY "log_overflow_policy"
+#define CONFIG_WEB_RATE_LIMIT_PER_SECOND "web_rate_limit_per_second"
+#define CONFIG_WEB_RATE_LIMIT_BURST "web_rate_limit_burst"
+#define CONFIG_BOT_RATE_LIMIT_PER_SECOND "bot_rate_limit_per_second"
+#define CONFIG_BOT_RATE_LIMIT_BURST "bot_rate_limit_burst"
+#define CONFIG_WEB_CONCURRENCY_MIN "web_concurrency_min"
+#define CONFIG_WEB_CONCURRENCY_MAX "web_concurrency_max"
+#define CONFIG_CAPTURE_FILE "capture_file"
+#define CONFIG_CAPTURE_MAX_MB "capture_max_mb"
+#define CONFIG_REPLAY_SIGNING_KEY "replay_signing_key"
+#define CONFIG_DISCORD_REST_STUBBED "discord_rest_stubbed"
+
+#define DEFAULT_DB_NAME "choretracker"
+#define DEFAULT_WEB_PORT 8080
+#define DEFAULT_WEB_BASE_URL "http://localhost:" STRINGIFY(DEFAULT_WEB_PORT)
+#define DEFAULT_ALERT_PARTITIONS 64
+#define DEFAULT_ALERT_LEASE_SECONDS 30
+#define DEFAULT_ALERT_BATCH_SIZE 25
+#define DEFAULT_DM_RATE_PER_SECOND 20
+#define DEFAULT_DM_MAX_ATTEMPTS 5
+#define DEFAULT_SHUTDOWN_DRAIN_SECONDS 20
+// A few readiness probe periods, so the load balancer has seen /healthz fail before the port closes
+#define DEFAULT_SHUTDOWN_GRACE_SECONDS 5
+#define DEFAULT_OAUTH_POOL_SIZE 4
+#define DEFAULT_OAUTH_CONNECT_TIMEOUT_MS 3000
+#define DEFAULT_OAUTH_READ_TIMEOUT_MS 10000
+#define DEFAULT_DB_READ_PREFERENCE "primary"
+// Slash commands, autocomplete and sending DMs need no gateway intents at all
+#define DEFAULT_GATEWAY_INTENTS ""
+#define DEFAULT_WRITE_QUEUE_DIR "write_queue"
+#define DEFAULT_LOG_QUEUE_SIZE 8192
+#define DEFAULT_LOG_OVERFLOW_POLICY "block"
+#define DEFAULT_WEB_RATE_LIMIT_PER_SECOND 10
+#define DEFAULT_WEB_RATE_LIMIT_BURST 30
+#define DEFAULT_BOT_RATE_LIMIT_PER_SECOND 2
+#define DEFAULT_BOT_RATE_LIMIT_BURST 10
+#define DEFAULT_WEB_CONCURRENCY_MIN 4
+// Matches the DB pool's default size, past that requests only queue for a client
+#define DEFAULT_WEB_CONCURRENCY_MAX 100
+#define DEFAULT_CAPTURE_MAX_MB 256
+
+/// @brief Immutable, fully parsed configuration
+///
+/// Built once from env vars and config.json, and rebuilt when config.json changes.
+/// Grab a snapshot with config_get() rather than holding on to individual values
+/// for anything that is reloadable.
+struct config_snapshot {
+    /* Only read at startup, changes need a restart. New settings stay here unless config_reload copies them over */
+    std::optional<std::string> bot_token;
+    std::optional<std::string> test_guild;
+    bool register_commands;
+    std::optional<std::string> db_connection;
+    std::string db_name;
+    int web_port;
+    std::string web_base_url;
+    std::optional<std::string> discord_client_id;
+    std::optional<std::string> discord_client_secret;
+    int alert_partitions;
+    int alert_lease_seconds;
+    int oauth_pool_size;
+    int oauth_connect_timeout_ms;
+    int oauth_read_timeout_ms;
+    std::string db_read_preference;
+    std::optional<int> db_pool_min;
+    std::optional<int> db_pool_max;
+    std::optional<int> db_wait_queue_timeout_ms;
+    std::optional<std::string> db_write_concern;
+    std::optional<std::string> db_coordination_write_concern;
+    std::optional<int> db_write_timeout_ms;
+    // Comma separated intent names, e.g. "guilds,direct_messages"
+    std::string gateway_intents;
+    int gateway_shard_count;
+    int gateway_cluster_id;
+    int gateway_cluster_count;
+    // Set to take slash commands over HTTP at /interactions
+    std::optional<std::string> interactions_public_key;
+    // Task writes are queued here while Mongo is unavailable. Each process needs its own, as
+    // it's locked while in use, e.g. by giving every role its own working directory
+    std::string write_queue_dir;
+    bool log_async;
+    int log_queue_size;
+    // block, overrun_oldest or discard_new
+    std::string log_overflow_policy;
+    // Set to record an anonymized workload trace here
+    std::optional<std::string> capture_file;
+    int capture_max_mb;
+    // Ed25519 private key (hex seed) replay signs interactions with, its public key goes in the target's interactions_public_key
+    std::optional<std::string> replay_signing_key;
+    // Log alert DMs, interaction edits and follow-ups instead of sending them, for replay targets
+    bool discord_rest_stubbed;
+
+    /* Safe to change at runtime */
+    std::optional<std::string> spdlog_level;
+    int alert_batch_size;
+    int dm_rate_per_second;
+    int dm_max_attempts;
+    int shutdown_drain_seconds;
+    // Least time /healthz fails for before the web server stops, even with nothing in flight
+    int shutdown_grace_seconds;
+    int web_rate_limit_per_second;
+    int web_rate_limit_burst;
+    int bot_rate_limit_per_second;
+    int bot_rate_limit_burst;
+    // Bounds for the adaptive limit on web requests in flight
+    int web_concurrency_min;
+    int web_concurrency_max;
+
+    bool operator==(const config_snapshot&) const = default;
+};
 
 bool config_load_file();
-std::optional<std::string> config_get_str(const std::string& property);
-std::optional<bool> config_get_bool(const std::string& property);
-std::optional<int> config_get_int(const std::string& property);
\ No newline at end of file
+std::shared_ptr<const config_snapshot> config_get();
+void config_watch();
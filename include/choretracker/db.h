@@ -1,18 +1,27 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <source_location>
 #include <vector>
 #include <bsoncxx/builder/basic/document.hpp>
 #include <bsoncxx/builder/basic/kvp.hpp>
 #include <mongocxx/pool.hpp>
+#include <mongocxx/read_preference.hpp>
+#include <mongocxx/write_concern.hpp>
 #include <mongocxx/instance.hpp>
 #include <mongocxx/uri.hpp>
 #include <dpp/dpp.h>
 #include <dpp/nlohmann/json.hpp>
 
+#include "choretracker/recurrence.h"
+#include "choretracker/single_flight.h"
 #include "choretracker/utils.hpp"
 
-#define DEFAULT_DB_NAME "choretracker"
+// Users are spread over this many write generation counters
+#define TASK_WRITE_GENERATION_STRIPES 256
 
 using bsoncxx::builder::basic::kvp;
 using bsoncxx::builder::basic::make_document;
@@ -39,34 +48,56 @@ inline task_type task_type_from_string(const std::string& type_str) {
 struct task_definition {
     dpp::snowflake owner_user_id;
     std::string name;
-    task_type type;
-    int32_t frequency_days;
-    std::chrono::year_month_day last_completed;
+    task_type type = task_type::regular;
+    int32_t frequency_days = 0;
+    std::chrono::year_month_day last_completed{};
+    // Schedule for regular tasks, replacing frequency_days when set. frequency_days then
+    // holds the typical gap between occurrences for anything that only knows about days
+    std::shared_ptr<const Recurrence> recurrence;
 
     // Computed values
-    int32_t days_since_completed;
-    int32_t days_overdue;
+    int32_t days_since_completed = 0;
+    int32_t days_overdue = 0;
+
+    std::chrono::year_month_day next_due() const {
+        if (recurrence) {
+            return std::chrono::year_month_day{ recurrence->next_due_after(std::chrono::sys_days(last_completed)) };
+        }
+        return std::chrono::year_month_day{ std::chrono::sys_days(last_completed) + std::chrono::days(frequency_days) };
+    }
 
     auto to_bson() const {
-        return make_document(
+        bsoncxx::builder::basic::document doc;
+        doc.append(
             kvp("owner_user_id", owner_user_id.str()),
             kvp("name", name),
             kvp("type", type),
             kvp("frequency_days", frequency_days),
-            kvp("last_completed", ymd_to_string(last_completed))
+            kvp("last_completed", ymd_to_string(last_completed)),
+            // Stored so listings can be sorted by due date in the query
+            kvp("next_due", ymd_to_string(next_due()))
         );
+        if (recurrence) {
+            doc.append(kvp("recurrence", recurrence->text()));
+        }
+        return doc.extract();
     }
 
     nlohmann::json to_json() const {
-        return {
+        nlohmann::json json = {
             { "owner_user_id", owner_user_id.str() },
             { "name", name },
             { "type", type },
             { "frequency_days", frequency_days },
             { "last_completed", ymd_to_string(last_completed) },
+            { "next_due", ymd_to_string(next_due()) },
             { "days_since_completed", days_since_completed },
             { "days_overdue", days_overdue }
         };
+        if (recurrence) {
+            json["recurrence"] = recurrence->text();
+        }
+        return json;
     }
     
     static std::optional<task_definition> from_bson(const bsoncxx::document::view& doc) {
@@ -77,9 +108,14 @@ struct task_definition {
             task.type = static_cast<task_type>(doc["type"].get_int32().value);
             task.frequency_days = doc["frequency_days"].get_int32().value;
             task.last_completed = parse_ymd(bson_to_string(doc["last_completed"])).value();
+            if (doc["recurrence"]) {
+                // Compiled rules are shared, so a scan over many tasks on the same schedule parses it once
+                task.recurrence = Recurrence::compile(bson_to_string(doc["recurrence"]));
+            }
             // Computed values
-            task.days_since_completed = (std::chrono::sys_days(get_today_as_ymd()) - std::chrono::sys_days(task.last_completed)).count();
-            task.days_overdue = task.days_since_completed - task.frequency_days;
+            auto today = std::chrono::sys_days(get_today_as_ymd());
+            task.days_since_completed = (today - std::chrono::sys_days(task.last_completed)).count();
+            task.days_overdue = (today - std::chrono::sys_days(task.next_due())).count();
 
             return task;
         } catch (const std::exception&) {
@@ -88,18 +124,46 @@ struct task_definition {
     }
 };
 
+enum class task_sort {
+    name,
+    due
+};
+
+// Options for a page of a user's task listing
+struct task_query {
+    task_sort sort = task_sort::name;
+    // Maximum tasks to return, 0 for no limit
+    size_t limit = 0;
+    // Sort value and _id of the last task on the previous page
+    std::optional<std::pair<std::string, std::string>> after;
+    // Fields to return, empty for all
+    std::vector<std::string> fields;
+};
+
+struct task_page {
+    std::vector<nlohmann::json> tasks;
+    // Position to continue from, if there are more tasks
+    std::optional<std::pair<std::string, std::string>> next;
+};
+
 struct user_session {
     std::string user_id;
     std::string session_cookie;
     std::string user_name;
     std::string avatar;
+    std::chrono::system_clock::time_point expires_at;
+
+    bool is_expired() const {
+        return expires_at <= std::chrono::system_clock::now();
+    }
 
     auto to_bson() const {
         return make_document(
             kvp("user_id", user_id),
             kvp("session_cookie", session_cookie),
             kvp("user_name", user_name),
-            kvp("avatar", avatar)
+            kvp("avatar", avatar),
+            kvp("expires_at", bsoncxx::types::b_date{expires_at})
         );
     }
 
@@ -119,6 +183,11 @@ struct user_session {
             session.session_cookie = bson_to_string(doc["session_cookie"]);
             session.user_name = bson_to_string(doc["user_name"]);
             session.avatar = bson_to_string(doc["avatar"]);
+            // Sessions created before expiry was tracked are treated as already expired
+            auto expires_at = doc["expires_at"];
+            if (expires_at && expires_at.type() == bsoncxx::type::k_date) {
+                session.expires_at = std::chrono::system_clock::time_point(expires_at.get_date().value);
+            }
 
             return session;
         } catch (const std::exception&) {
@@ -127,21 +196,299 @@ struct user_session {
     }
 };
 
+// One month of completions for a task, with running totals kept up to date on write
+struct completion_bucket {
+    std::string month;
+    int32_t count;
+    // Days between each completion in this month and the one before it
+    int64_t interval_sum_days;
+    int32_t interval_count;
+    std::chrono::year_month_day first_completed;
+    std::chrono::year_month_day last_completed;
+
+    nlohmann::json to_json() const {
+        nlohmann::json json = {
+            { "month", month },
+            { "count", count },
+            { "first_completed", ymd_to_string(first_completed) },
+            { "last_completed", ymd_to_string(last_completed) }
+        };
+        if (interval_count > 0) {
+            json["average_interval_days"] = static_cast<double>(interval_sum_days) / interval_count;
+        } else {
+            json["average_interval_days"] = nullptr;
+        }
+        return json;
+    }
+
+    static std::optional<completion_bucket> from_bson(const bsoncxx::document::view& doc) {
+        try {
+            completion_bucket bucket;
+            bucket.month = bson_to_string(doc["month"]);
+            bucket.count = doc["count"].get_int32().value;
+            bucket.interval_sum_days = doc["interval_sum_days"].get_int64().value;
+            bucket.interval_count = doc["interval_count"].get_int32().value;
+            bucket.first_completed = parse_ymd(bson_to_string(doc["first_completed"])).value();
+            bucket.last_completed = parse_ymd(bson_to_string(doc["last_completed"])).value();
+
+            return bucket;
+        } catch (const std::exception&) {
+            return {};
+        }
+    }
+};
+
+#define DEFAULT_ALERT_MINUTES (6 * 60)
+// Interaction tokens only last this long, and so do requests to run alerts that report back on one
+#define ALERT_RUN_REQUEST_TTL std::chrono::minutes(15)
+
+// A /runalerts taken by a process that doesn't alert, for an alerting process to pick up
+struct alert_run_request {
+    std::string interaction_token;
+    dpp::snowflake application_id;
+};
+
+struct user_settings {
+    std::string user_id;
+    // Minutes after local midnight to send the daily alert
+    int32_t alert_minutes = DEFAULT_ALERT_MINUTES;
+    // IANA time zone name, empty for the server's time zone
+    std::string time_zone;
+    // User-local date of the last alert sent
+    std::optional<std::chrono::year_month_day> last_alerted;
+    // DM channel alerts are posted to, empty if not yet known
+    std::string dm_channel_id;
+
+    nlohmann::json to_json() const {
+        return {
+            { "alert_time", std::format("{:02}:{:02}", alert_minutes / 60, alert_minutes % 60) },
+            { "time_zone", time_zone }
+        };
+    }
+
+    static std::optional<user_settings> from_bson(const bsoncxx::document::view& doc) {
+        try {
+            user_settings settings;
+            settings.user_id = bson_to_string(doc["user_id"]);
+            if (doc["alert_minutes"]) {
+                settings.alert_minutes = doc["alert_minutes"].get_int32().value;
+            }
+            if (doc["time_zone"]) {
+                settings.time_zone = bson_to_string(doc["time_zone"]);
+            }
+            if (doc["last_alerted"]) {
+                settings.last_alerted = parse_ymd(bson_to_string(doc["last_alerted"]));
+            }
+            if (doc["dm_channel_id"]) {
+                settings.dm_channel_id = bson_to_string(doc["dm_channel_id"]);
+            }
+
+            return settings;
+        } catch (const std::exception&) {
+            return {};
+        }
+    }
+};
+
+enum class task_mutation_type {
+    add = 0,
+    complete = 1,
+    remove = 2
+};
+
+// A task write, carried through the write-ahead queue when Mongo is unavailable
+struct task_mutation {
+    uint64_t sequence = 0;
+    // Lets replays recognise a write that already made it to Mongo
+    std::string idempotency_key;
+    task_mutation_type type = task_mutation_type::add;
+    // Owner and name for every mutation, the full definition for adds
+    task_definition task;
+    // Day the task was completed, for completions
+    std::chrono::year_month_day completed_on{};
+    std::chrono::system_clock::time_point accepted_at;
+
+    nlohmann::json to_json() const {
+        nlohmann::json json = {
+            { "sequence", sequence },
+            { "idempotency_key", idempotency_key },
+            { "type", static_cast<int>(type) },
+            { "owner_user_id", task.owner_user_id.str() },
+            { "name", task.name },
+            { "accepted_at", std::chrono::duration_cast<std::chrono::milliseconds>(accepted_at.time_since_epoch()).count() }
+        };
+        // Only what each type of write uses, the rest of the definition isn't set
+        switch (type) {
+            case task_mutation_type::add:
+                json["task_type"] = task.type;
+                json["frequency_days"] = task.frequency_days;
+                json["last_completed"] = ymd_to_string(task.last_completed);
+                if (task.recurrence) {
+                    json["recurrence"] = task.recurrence->text();
+                }
+                break;
+            case task_mutation_type::complete:
+                json["completed_on"] = ymd_to_string(completed_on);
+                break;
+            case task_mutation_type::remove:
+                break;
+        }
+        return json;
+    }
+
+    static std::optional<task_mutation> from_json(const nlohmann::json& json) {
+        try {
+            task_mutation mutation{};
+            mutation.sequence = json.at("sequence").get<uint64_t>();
+            mutation.idempotency_key = json.at("idempotency_key").get<std::string>();
+            mutation.type = static_cast<task_mutation_type>(json.at("type").get<int>());
+            mutation.task.owner_user_id = dpp::snowflake(json.at("owner_user_id").get<std::string>());
+            mutation.task.name = json.at("name").get<std::string>();
+            switch (mutation.type) {
+                case task_mutation_type::add:
+                    mutation.task.type = static_cast<task_type>(json.at("task_type").get<int>());
+                    mutation.task.frequency_days = json.at("frequency_days").get<int32_t>();
+                    mutation.task.last_completed = parse_ymd(json.at("last_completed").get<std::string>()).value();
+                    if (json.contains("recurrence")) {
+                        mutation.task.recurrence = Recurrence::compile(json.at("recurrence").get<std::string>());
+                    }
+                    break;
+                case task_mutation_type::complete:
+                    mutation.completed_on = parse_ymd(json.at("completed_on").get<std::string>()).value();
+                    break;
+                case task_mutation_type::remove:
+                    break;
+                default:
+                    return {};
+            }
+            mutation.accepted_at = std::chrono::system_clock::time_point(std::chrono::milliseconds(json.at("accepted_at").get<int64_t>()));
+
+            return mutation;
+        } catch (const std::exception&) {
+            return {};
+        }
+    }
+};
+
+// Connection pool and routing settings, empty values keep the driver defaults
+struct database_options {
+    // primary, primaryPreferred, secondary, secondaryPreferred or nearest
+    std::string read_preference = "primary";
+    // Clients opened up front and kept in the pool
+    std::optional<int> pool_min;
+    std::optional<int> pool_max;
+    std::optional<int> wait_queue_timeout_ms;
+    // "majority" or a node count, for everyday writes
+    std::optional<std::string> write_concern;
+    // "majority" or a node count, for alert claims and partition leases
+    std::optional<std::string> coordination_write_concern;
+    std::optional<int> write_timeout_ms;
+};
+
+std::chrono::steady_clock::duration db_thread_time();
+bool db_is_unavailable(const std::exception& e);
+
 class Database {
     public:
-        Database(const std::string& connection_uri, const std::string& db_name) : pool(mongocxx::uri(connection_uri)), db_name(db_name) {}
+        Database(const std::string& connection_uri, const std::string& db_name, const database_options& options = {});
 
         std::vector<task_definition> list_all_tasks();
         std::vector<task_definition> list_tasks_by_user(const dpp::snowflake& user_id);
+        std::optional<task_page> list_tasks_page(const dpp::snowflake& user_id, const task_query& query);
         std::vector<task_definition> find_tasks_by_name(const dpp::snowflake& user_id, const std::string &query);
         bool add_task(const task_definition& task);
+        size_t insert_tasks(const std::vector<task_definition>& tasks);
+        void for_each_task(const std::optional<dpp::snowflake>& user_id, const std::function<void(const task_definition&)>& callback);
         bool delete_task(const dpp::snowflake& user_id, const std::string& task_name);
-        bool complete_task(const dpp::snowflake& user_id, const std::string& task_name);
+        bool complete_task(const dpp::snowflake& user_id, const std::string& task_name,
+                const std::optional<std::chrono::year_month_day>& completed_on = {}, const std::string& idempotency_key = "");
+        bool apply_mutation(const task_mutation& mutation);
+        std::vector<completion_bucket> list_completion_buckets(const dpp::snowflake& user_id, const std::string& task_name);
 
         std::optional<user_session> get_session_by_cookie(const std::string& session_cookie);
         bool add_session(const user_session& session);
+        bool renew_session(const std::string& session_cookie, std::chrono::system_clock::time_point expires_at);
+        bool delete_session(const std::string& session_cookie);
+
+        bool heartbeat_node(const std::string& node_id, std::chrono::system_clock::time_point expires_at);
+        bool remove_node(const std::string& node_id);
+        std::vector<std::string> list_live_nodes();
+        bool acquire_partition_lease(int partition, const std::string& node_id, std::chrono::system_clock::time_point expires_at);
+        bool release_partition_lease(int partition, const std::string& node_id);
+
+        std::vector<std::string> list_task_owners();
+        std::vector<user_settings> list_user_settings();
+        std::optional<user_settings> get_user_settings(const std::string& user_id);
+        bool set_user_settings(const user_settings& settings);
+        bool claim_user_alert(const std::string& user_id, const std::chrono::year_month_day& local_date);
+        bool release_user_alert(const std::string& user_id, const std::chrono::year_month_day& local_date);
+        bool set_dm_channel(const std::string& user_id, const std::string& channel_id);
+        bool record_alert_delivery(const std::string& user_id, bool delivered, const std::string& error);
+        bool request_alert_run(const alert_run_request& request);
+        std::optional<alert_run_request> claim_alert_run_request(const std::string& node_id);
     private:
+        /// @brief Client checked out of the pool, handed back when this goes out of scope
+        class pooled_client {
+            public:
+                pooled_client(const Database& database, mongocxx::pool::entry entry, const char* caller, std::chrono::steady_clock::time_point started);
+                ~pooled_client();
+                pooled_client(const pooled_client&) = delete;
+                pooled_client& operator=(const pooled_client&) = delete;
+
+                /// @brief Primary, for writes and anything that must read its own writes
+                mongocxx::database primary();
+                /// @brief Routed by the configured read preference, for reads that can lag slightly
+                mongocxx::database reader();
+                /// @brief Primary with the coordination write concern, for claims and leases
+                mongocxx::database coordination();
+            private:
+                const Database& database;
+                mongocxx::pool::entry entry;
+                // Set while capturing, to time the call for the workload trace
+                const char* caller;
+                std::chrono::steady_clock::time_point started;
+                int exceptions_at_acquire;
+        };
+
+        /// @brief Bumps the write generation of every user added once a task write is over, however it ends
+        class write_generation_bump {
+            public:
+                write_generation_bump(Database& database) : database(database) {}
+                write_generation_bump(Database& database, const dpp::snowflake& user_id) : database(database), user_ids({ user_id }) {}
+                ~write_generation_bump() {
+                    for (const auto& user_id : user_ids) {
+                        database.bump_write_generation(user_id);
+                    }
+                }
+                write_generation_bump(const write_generation_bump&) = delete;
+                write_generation_bump& operator=(const write_generation_bump&) = delete;
+
+                void add(const dpp::snowflake& user_id) { user_ids.push_back(user_id); }
+            private:
+                Database& database;
+                std::vector<dpp::snowflake> user_ids;
+        };
+
+        void init();
+        void bump_write_generation(const dpp::snowflake& user_id);
+        std::string flight_key(const dpp::snowflake& user_id) const;
+        pooled_client acquire(std::source_location location = std::source_location::current());
+        std::vector<task_definition> fetch_tasks_by_user(const dpp::snowflake& user_id);
+        std::vector<task_definition> fetch_tasks_by_name(const dpp::snowflake& user_id, const std::string &query);
+        std::optional<task_page> fetch_tasks_page(const dpp::snowflake& user_id, const task_query& query);
+
         mongocxx::instance instance;
         mongocxx::pool pool;
         std::string db_name;
+        mongocxx::read_preference read_preference;
+        std::optional<mongocxx::write_concern> write_concern;
+        std::optional<mongocxx::write_concern> coordination_write_concern;
+
+        // Bumped after each of a user's task writes. Part of every shared read's key, so a read
+        // started after a write never joins a query that started before it
+        std::array<std::atomic<uint64_t>, TASK_WRITE_GENERATION_STRIPES> task_write_generations{};
+        // Concurrent identical reads (several tabs, fast autocomplete typing) share one query
+        SingleFlight<std::vector<task_definition>> tasks_by_user_flight{ "list_tasks_by_user" };
+        SingleFlight<std::vector<task_definition>> tasks_by_name_flight{ "find_tasks_by_name" };
+        SingleFlight<std::optional<task_page>> tasks_page_flight{ "list_tasks_page" };
 };
\ No newline at end of file
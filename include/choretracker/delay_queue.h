@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+/// @brief Runs tasks on a background thread once their delay is up
+class DelayQueue {
+    public:
+        DelayQueue();
+        ~DelayQueue();
+
+        void schedule(std::chrono::steady_clock::duration delay, std::function<void()> task);
+        /// @brief Let anything already scheduled run, then stop the thread
+        void stop();
+    private:
+        void thread_task();
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> tasks;
+        bool stopping = false;
+        std::thread thread;
+};
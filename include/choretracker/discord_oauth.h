@@ -1,12 +1,22 @@
 #pragma once
 
+#include <chrono>
 #include <dpp/nlohmann/json.hpp>
+#include <optional>
 #include <string>
 
+#include "choretracker/config.h"
+#include "choretracker/http_pool.h"
+
+#define DISCORD_API_BASE_URL "https://discord.com"
+
 class DiscordOAuth {
     public:
         DiscordOAuth(const std::string& client_id, const std::string& client_secret, const std::string& redirect_uri) 
-            : client_id(client_id), client_secret(client_secret), redirect_uri(redirect_uri) {}
+            : client_id(client_id), client_secret(client_secret), redirect_uri(redirect_uri),
+            clients(DISCORD_API_BASE_URL, config_get()->oauth_pool_size, 
+                std::chrono::milliseconds(config_get()->oauth_connect_timeout_ms), 
+                std::chrono::milliseconds(config_get()->oauth_read_timeout_ms)) {}
 
         std::string generate_authorize_url();
         std::optional<nlohmann::json> exchange_code_for_token(const std::string& code);
@@ -15,4 +25,5 @@ class DiscordOAuth {
         std::string client_id;
         std::string client_secret;
         std::string redirect_uri;
+        HttpClientPool clients;
 };
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <dpp/dpp.h>
+
+#include "choretracker/config.h"
+#include "choretracker/db.h"
+#include "choretracker/metrics.h"
+
+/// @brief Outbound queue for alert DMs that paces sends to Discord's rate limits
+///
+/// Sends are limited to a steady rate, and additionally held back by the bucket
+/// state Discord reports on each response. 429s and 5xxs are retried with
+/// backoff, and the final outcome for each user is recorded in the database.
+class AlertDispatcher {
+    public:
+        AlertDispatcher(Database& db, dpp::cluster& bot);
+
+        void begin();
+        void stop(std::chrono::seconds timeout);
+        void enqueue(const dpp::snowflake& user_id, const dpp::message& message, 
+            const std::optional<std::chrono::year_month_day>& claim_date = {});
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct dispatch_job {
+            dpp::snowflake user_id;
+            dpp::message message;
+            // Alert claim to hand back if we shut down before this is sent
+            std::optional<std::chrono::year_month_day> claim_date;
+            int attempts = 0;
+        };
+
+        struct bucket_state {
+            uint64_t remaining = 1;
+            clock::time_point reset_at;
+        };
+
+        void thread_task();
+        void send_to_channel(dispatch_job job, const dpp::snowflake& channel_id);
+        void send_via_new_channel(dispatch_job job);
+        void on_result(dispatch_job job, const dpp::confirmation_callback_t& result);
+        void retry_later(dispatch_job job, clock::duration delay);
+        void update_depth();
+
+        Database& db;
+        dpp::cluster& bot;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<dispatch_job> ready;
+        std::multimap<clock::time_point, dispatch_job> delayed;
+        size_t in_flight = 0;
+        bool stopping = false;
+
+        // Rate limit state learnt from Discord responses
+        clock::time_point global_pause_until;
+        std::unordered_map<std::string, bucket_state> buckets;
+        std::unordered_map<dpp::snowflake, std::string> user_buckets;
+
+        // Persisted user -> DM channel mapping, saving a channel lookup per alert
+        std::unordered_map<dpp::snowflake, dpp::snowflake> dm_channels;
+
+        std::thread thread;
+
+        Metric& queue_depth;
+        Metric& sent_total;
+        Metric& failed_total;
+        Metric& retried_total;
+        Metric& rate_limited_total;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <httplib.h>
+
+/// @brief Thread-safe pool of keep-alive HTTP(S) clients for a single host
+///
+/// Each client holds its connection open between requests, so after warm-up calls
+/// skip the DNS lookup and TLS handshake. A client is only ever used by one thread
+/// at a time.
+class HttpClientPool {
+    public:
+        class lease {
+            public:
+                lease(HttpClientPool& pool, std::unique_ptr<httplib::Client> client) : pool(&pool), client(std::move(client)) {}
+                lease(lease&& other) = default;
+                lease& operator=(lease&& other) = delete;
+                ~lease() {
+                    if (client) {
+                        pool->release(std::move(client));
+                    }
+                }
+
+                httplib::Client* operator->() { return client.get(); }
+            private:
+                HttpClientPool* pool;
+                std::unique_ptr<httplib::Client> client;
+        };
+
+        HttpClientPool(const std::string& base_url, size_t max_size, 
+            std::chrono::milliseconds connect_timeout, std::chrono::milliseconds read_timeout);
+
+        lease acquire();
+    private:
+        std::unique_ptr<httplib::Client> create();
+        void release(std::unique_ptr<httplib::Client> client);
+
+        std::string base_url;
+        size_t max_size;
+        std::chrono::milliseconds connect_timeout;
+        std::chrono::milliseconds read_timeout;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<std::unique_ptr<httplib::Client>> idle;
+        size_t created = 0;
+};
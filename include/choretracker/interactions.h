@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <openssl/evp.h>
+
+// Discord's interaction types
+#define INTERACTION_TYPE_PING 1
+#define INTERACTION_TYPE_APPLICATION_COMMAND 2
+#define INTERACTION_TYPE_AUTOCOMPLETE 4
+
+#define ED25519_PUBLIC_KEY_SIZE 32
+#define ED25519_PRIVATE_KEY_SIZE 32
+#define ED25519_SIGNATURE_SIZE 64
+
+/// @brief Checks the Ed25519 signature Discord puts on each HTTP interaction
+class InteractionVerifier {
+    public:
+        /// @param public_key_hex Application public key, from the developer portal
+        InteractionVerifier(const std::string& public_key_hex);
+
+        /// @brief Check a request against its X-Signature-Ed25519 and X-Signature-Timestamp headers
+        /// @return Whether the signature is valid for the timestamp and body
+        bool verify(const std::string& timestamp, const std::string& body, const std::string& signature_hex) const;
+
+        bool valid() const { return key != nullptr; }
+    private:
+        std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key;
+};
+
+/// @brief Signs interactions the way Discord does, so a trace replay can deliver them
+class InteractionSigner {
+    public:
+        /// @param private_key_hex Ed25519 private key seed
+        InteractionSigner(const std::string& private_key_hex);
+
+        /// @brief Public key to set as the receiving instance's interactions_public_key
+        std::string public_key() const;
+        /// @return Hex signature for the X-Signature-Ed25519 header, empty on failure
+        std::string sign(const std::string& timestamp, const std::string& body) const;
+
+        bool valid() const { return key != nullptr; }
+    private:
+        std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key;
+};
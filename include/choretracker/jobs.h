@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Least time between progress reports for a running job
+#define JOB_PROGRESS_INTERVAL std::chrono::seconds(2)
+
+enum class job_state {
+    queued,
+    running,
+    succeeded,
+    failed
+};
+
+/// @brief Snapshot of a job, handed to whoever triggered it
+struct job_status {
+    std::string name;
+    job_state state;
+    size_t done = 0;
+    size_t total = 0;
+    // Time spent running so far, or in total once finished
+    std::chrono::milliseconds elapsed{ 0 };
+    std::string error;
+    // Other triggers folded into this run
+    size_t coalesced = 0;
+};
+
+/// @brief Called as a job starts, makes progress and finishes
+using job_listener = std::function<void(const job_status& status)>;
+/// @brief Lets a job report how far through it is
+using job_progress = std::function<void(size_t done, size_t total)>;
+/// @brief Work to run, throwing marks the job failed
+using job_work = std::function<void(const job_progress& progress)>;
+
+/// @brief Runs named jobs one at a time on a background thread
+///
+/// Triggering a job that's already queued joins that run instead of starting
+/// another one, and its listener hears about the shared run. Triggering one that's
+/// running queues a single run to follow it, which later triggers join.
+class JobExecutor {
+    public:
+        JobExecutor();
+        ~JobExecutor();
+
+        /// @brief Queue a job, or join the queued run of a job with the same name
+        /// @return Whether a new run was queued
+        bool submit(const std::string& name, job_work work, job_listener listener);
+        /// @brief Finish the current job and drop anything still queued
+        void stop();
+    private:
+        struct job {
+            job_status status;
+            job_work work;
+            std::vector<job_listener> listeners;
+            std::chrono::steady_clock::time_point last_report;
+        };
+
+        void thread_task();
+        void notify(job& job, bool force);
+
+        std::deque<std::shared_ptr<job>> queue;
+        std::shared_ptr<job> running;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool stopping = false;
+        std::thread thread;
+};
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "choretracker/config.h"
+
+void logging_init(const config_snapshot& config, bool use_stderr);
+void logging_shutdown();
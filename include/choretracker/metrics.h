@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+enum class metric_type {
+    counter,
+    gauge,
+    summary
+};
+
+/// @brief A single Prometheus-style value, safe to update from any thread
+class Metric {
+    public:
+        void inc(int64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+        void dec(int64_t amount = 1) { value.fetch_sub(amount, std::memory_order_relaxed); }
+        void set(int64_t new_value) { value.store(new_value, std::memory_order_relaxed); }
+        int64_t get() const { return value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<int64_t> value = 0;
+};
+
+/// @brief Running sum and count of observations, e.g. request durations, rendered as _sum and _count
+class Summary {
+    public:
+        void observe(int64_t value) {
+            total.fetch_add(value, std::memory_order_relaxed);
+            observations.fetch_add(1, std::memory_order_relaxed);
+        }
+        int64_t sum() const { return total.load(std::memory_order_relaxed); }
+        int64_t count() const { return observations.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<int64_t> total = 0;
+        std::atomic<int64_t> observations = 0;
+};
+
+/// @brief Process-wide registry of metrics, rendered for /metrics
+///
+/// Metrics are registered on first use and live for the whole process, so callers
+/// can hold on to the returned reference. Labels are part of the name, e.g.
+/// `metrics_counter("requests_total{route=\"tasks\"}", "...")`.
+Metric& metrics_counter(const std::string& name, const std::string& help);
+Metric& metrics_gauge(const std::string& name, const std::string& help);
+Summary& metrics_summary(const std::string& name, const std::string& help);
+std::string metrics_render();
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <dpp/dpp.h>
+
+#include "choretracker/db.h"
+
+/// @brief Splits alert work across replicas using Mongo-backed partition leases
+///
+/// Every replica heartbeats into a shared membership list. Partitions are assigned to
+/// live nodes with rendezvous hashing, and a node only works a partition while it
+/// holds that partition's lease, so each user is handled by exactly one replica.
+class PartitionCoordinator {
+    public:
+        PartitionCoordinator(Database& db, int partition_count, std::chrono::seconds lease_duration);
+
+        bool heartbeat();
+        bool drop();
+        void leave();
+        bool owns_user(const dpp::snowflake& user_id);
+
+        int partition_for(const dpp::snowflake& user_id) const;
+        std::chrono::seconds heartbeat_interval() const { return lease_duration / 3; }
+        const std::string& get_node_id() const { return node_id; }
+    private:
+        std::set<int> assign_partitions(const std::vector<std::string>& nodes) const;
+
+        Database& db;
+        std::string node_id;
+        int partition_count;
+        std::chrono::seconds lease_duration;
+
+        std::mutex owned_mutex;
+        std::set<int> owned_partitions;
+};
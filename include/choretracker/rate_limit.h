@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "choretracker/metrics.h"
+
+// Independent locks, so callers for different users rarely contend
+#define RATE_LIMIT_SHARDS 16
+// Idle buckets are dropped once a shard holds this many
+#define RATE_LIMIT_SWEEP_THRESHOLD 1024
+
+/// @brief Per-key token buckets, split across shards by key hash
+///
+/// Limits are passed on each call so they can follow config reloads.
+class RateLimiter {
+    public:
+        /// @param name Label for this limiter's metrics, e.g. "web"
+        RateLimiter(const std::string& name);
+
+        /// @brief Take a token for a key
+        /// @param rate_per_second Tokens added back each second
+        /// @param burst Most tokens a bucket can hold
+        /// @return Empty if allowed, otherwise how long until a token is available
+        std::optional<std::chrono::milliseconds> acquire(const std::string& key, int rate_per_second, int burst);
+    private:
+        struct bucket {
+            double tokens;
+            std::chrono::steady_clock::time_point updated;
+        };
+
+        struct shard {
+            std::mutex mutex;
+            std::unordered_map<std::string, bucket> buckets;
+        };
+
+        void sweep(shard& shard, std::chrono::steady_clock::time_point now, int rate_per_second, int burst);
+
+        std::array<shard, RATE_LIMIT_SHARDS> shards;
+        Metric& allowed;
+        Metric& limited;
+        Metric& tracked;
+        Metric& rate_gauge;
+        Metric& burst_gauge;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Longest interval a rule can repeat on
+#define RECURRENCE_MAX_INTERVAL_DAYS 3650
+
+enum class recurrence_kind : uint8_t {
+    // Every N days after the last completion
+    interval,
+    // On set days of the week
+    weekly,
+    // On set days of the month
+    monthly
+};
+
+/// @brief A schedule such as "every 2 weeks", "every monday and thursday" or "1st of the month"
+///
+/// Rules are parsed once into lookup tables, so working out the next due date is a
+/// table lookup plus one calendar conversion, however many days the rule names.
+/// Rules are immutable and shared between every task using the same text.
+class Recurrence {
+    public:
+        /// @brief Parse rule text, reusing the compiled rule if the same rule was seen before
+        /// @return Compiled rule, or empty if the text isn't a schedule
+        static std::shared_ptr<const Recurrence> compile(std::string_view text);
+
+        /// @brief First scheduled day strictly after a date
+        std::chrono::sys_days next_due_after(std::chrono::sys_days date) const;
+        /// @brief Whether a task last completed on last_completed is due (or overdue) on day
+        bool is_due_on(std::chrono::sys_days day, std::chrono::sys_days last_completed) const {
+            return next_due_after(last_completed) <= day;
+        }
+
+        recurrence_kind kind() const { return rule_kind; }
+        /// @brief Typical days between occurrences, for older clients that only know frequency_days
+        int32_t nominal_days() const;
+        /// @brief Canonical text, which compiles back to the same rule
+        const std::string& text() const { return canonical; }
+    private:
+        Recurrence() = default;
+        static std::optional<Recurrence> parse(std::string_view text);
+        void build_tables();
+
+        recurrence_kind rule_kind = recurrence_kind::interval;
+        uint16_t interval_days = 0;
+        // Bit per weekday, Sunday is bit 0
+        uint8_t weekdays = 0;
+        // Bit per day of the month, bit 0 is the last day. Days past the end of a short
+        // month fall on its last day
+        uint32_t month_days = 0;
+        std::string canonical;
+
+        // Days from each weekday to the next scheduled weekday, 1 to 7
+        std::array<uint8_t, 7> weekday_next{};
+        // By month length (28 to 31), the next scheduled day after each day of the month, 0 if none
+        std::array<std::array<uint8_t, 32>, 4> month_day_next{};
+        // By month length, the first scheduled day of the month
+        std::array<uint8_t, 4> month_day_first{};
+};
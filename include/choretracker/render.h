@@ -0,0 +1,14 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "choretracker/db.h"
+
+#define DISCORD_MESSAGE_LIMIT 2000
+
+std::vector<std::string> split_message(std::string_view text, size_t limit = DISCORD_MESSAGE_LIMIT);
+std::vector<std::string> render_task_list(const std::vector<task_definition>& tasks);
+std::vector<std::string> render_alert(const std::vector<task_definition>& tasks, std::chrono::sys_days today);
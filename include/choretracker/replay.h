@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <string>
+
+#include "choretracker/db.h"
+
+// Requests in flight at once against the target
+#define REPLAY_WORKERS 64
+// Records are written as they finish, so hold them this long to put them back in start order
+#define REPLAY_REORDER_WINDOW std::chrono::seconds(30)
+// Synthetic sessions last this long, more than enough for a replay
+#define REPLAY_SESSION_TTL std::chrono::days(1)
+
+struct replay_options {
+    std::string trace_path;
+    // 1 for real time, 10 to replay ten times faster
+    double speed = 1;
+    // Base URL of the instance under test
+    std::string target;
+    // Hex Ed25519 seed to sign interactions with, commands and autocomplete are skipped without it
+    std::optional<std::string> signing_key;
+};
+
+/// @brief Drive a local instance from a captured workload trace, then print how it compared
+///
+/// Requests, slash commands and autocomplete go to the target over HTTP, with
+/// interactions signed like Discord would. Each anonymized user gets a synthetic
+/// session in the target's (stand-in) Mongo, and task names are rebuilt from their
+/// hashes so adds, completes and deletes still land on the same tasks. DB calls in
+/// the trace aren't replayed, the requests that made them are, and they're shown
+/// alongside for comparison.
+/// @param db The target's database, where synthetic sessions are added
+/// @return Process exit code
+int run_replay(Database& db, const replay_options& options);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief Min-heap of per-user alert times, popped in small batches as they come due
+///
+/// Not thread safe, owned by the alerter thread.
+class AlertScheduler {
+    public:
+        using time_point = std::chrono::system_clock::time_point;
+
+        void schedule(const std::string& user_id, time_point at);
+        std::vector<std::string> pop_due(time_point now, size_t max_count);
+        std::optional<time_point> next_due() const;
+        void clear();
+        size_t size() const { return heap.size(); }
+    private:
+        using entry = std::pair<time_point, std::string>;
+
+        std::priority_queue<entry, std::vector<entry>, std::greater<entry>> heap;
+};
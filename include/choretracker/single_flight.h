@@ -0,0 +1,63 @@
+#pragma once
+
+#include <exception>
+#include <format>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "choretracker/metrics.h"
+
+/// @brief Coalesces concurrent calls with the same key into one
+///
+/// The first caller for a key runs the work, and anyone asking for the same key
+/// while it's running waits for and shares that result. Nothing is cached once
+/// the call finishes.
+template <typename T>
+class SingleFlight {
+    public:
+        /// @param name Label for this group's metrics, e.g. "list_tasks_by_user"
+        SingleFlight(const std::string& name)
+            : executed(metrics_counter(std::format("single_flight_total{{query=\"{}\",result=\"executed\"}}", name), "Calls that ran their own query")),
+            coalesced(metrics_counter(std::format("single_flight_total{{query=\"{}\",result=\"coalesced\"}}", name), "Calls that shared a query already in flight")) {
+        }
+
+        T run(const std::string& key, const std::function<T()>& work) {
+            std::unique_lock lock(mutex);
+            auto it = in_flight.find(key);
+            if (it != in_flight.end()) {
+                auto result = it->second;
+                lock.unlock();
+                coalesced.inc();
+                return result.get();
+            }
+
+            std::promise<T> promise;
+            in_flight.emplace(key, promise.get_future().share());
+            lock.unlock();
+            executed.inc();
+
+            try {
+                T result = work();
+                finish(key);
+                promise.set_value(result);
+                return result;
+            } catch (...) {
+                finish(key);
+                promise.set_exception(std::current_exception());
+                throw;
+            }
+        }
+    private:
+        void finish(const std::string& key) {
+            std::lock_guard lock(mutex);
+            in_flight.erase(key);
+        }
+
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_future<T>> in_flight;
+        Metric& executed;
+        Metric& coalesced;
+};
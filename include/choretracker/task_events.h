@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <dpp/nlohmann/json.hpp>
+
+enum class task_event_action {
+    added,
+    deleted,
+    completed,
+    imported
+};
+
+struct task_event {
+    task_event_action action;
+    std::string task_name;
+
+    nlohmann::json to_json() const {
+        std::string action_str;
+        switch (action) {
+            case task_event_action::added:
+                action_str = "added";
+                break;
+            case task_event_action::deleted:
+                action_str = "deleted";
+                break;
+            case task_event_action::completed:
+                action_str = "completed";
+                break;
+            case task_event_action::imported:
+                action_str = "imported";
+                break;
+        }
+
+        return {
+            { "action", action_str },
+            { "name", task_name }
+        };
+    }
+};
+
+/// @brief In-process fan-out of task changes to everyone watching a user's tasks
+class TaskEventHub {
+    public:
+        using subscriber = std::function<void(const std::string& payload)>;
+
+        /// @brief Call back with each event published for a user, on the publisher's thread
+        /// @param callback Must only queue the payload (e.g. websocket send_text) and never block
+        uint64_t subscribe(const std::string& user_id, subscriber callback);
+        /// @brief Stop calling a subscriber, waiting for any call already in progress to return,
+        /// so whatever its callback captured can be freed straight after
+        void unsubscribe(const std::string& user_id, uint64_t subscription_id);
+        void publish(const std::string& user_id, const task_event& event);
+    private:
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, std::unordered_map<uint64_t, subscriber>> subscribers;
+        std::atomic<uint64_t> next_subscription_id = 1;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "choretracker/db.h"
+
+// Tasks inserted per insert_many call when importing
+#define IMPORT_BATCH_SIZE 500
+
+/// @brief Write tasks as NDJSON, one task per line, straight from the DB cursor
+/// @param user_id Only export this user's tasks, or every task if empty
+/// @return Number of tasks written
+size_t export_tasks(Database& db, std::ostream& out, const std::optional<dpp::snowflake>& user_id = {});
+
+/// @brief Reads NDJSON task lines and inserts them in bounded batches
+///
+/// Lines that aren't valid tasks, and tasks whose owner already has one by that name,
+/// are skipped and counted.
+class TaskImporter {
+    public:
+        /// @param owner Import every task as this user, otherwise each line's owner_user_id is used
+        TaskImporter(Database& db, const std::optional<dpp::snowflake>& owner = {}) : db(db), owner(owner) {
+            batch.reserve(IMPORT_BATCH_SIZE);
+        }
+
+        /// @brief Parse a single line, inserting the batch once it's full
+        /// @return Whether the line held a valid task (blank lines are ignored and count as valid)
+        bool add_line(std::string_view line);
+        /// @brief Insert whatever is left in the current batch
+        void finish();
+
+        size_t imported() const { return imported_count; }
+        size_t skipped() const { return skipped_count; }
+    private:
+        void flush();
+
+        Database& db;
+        std::optional<dpp::snowflake> owner;
+        std::vector<task_definition> batch;
+        size_t imported_count = 0;
+        size_t skipped_count = 0;
+};
+
+/// @brief Import NDJSON tasks from a stream, a line at a time
+/// @return Importer holding the imported and skipped counts
+TaskImporter import_tasks(Database& db, std::istream& in, const std::optional<dpp::snowflake>& owner = {});
@@ -3,11 +3,13 @@
 #include <algorithm>
 #include <chrono>
 #include <cctype>
+#include <cstdint>
 #include <format>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <stdexcept>
+#include <vector>
 #include <spdlog/spdlog.h>
 #include <bsoncxx/document/view.hpp>
 #include <bsoncxx/string/to_string.hpp>
@@ -32,6 +34,50 @@ inline constexpr int hexDigitToInt(char hex) noexcept {
    return 0; // Should not reach here if input is validated
 }
 
+/// @brief Decode a hex string, failing on odd lengths or non-hex characters
+/// @param hex Hex string
+/// @return Bytes if valid
+inline std::optional<std::vector<unsigned char>> hex_decode(std::string_view hex) {
+   if (hex.size() % 2 != 0) {
+      return {};
+   }
+
+   std::vector<unsigned char> bytes;
+   bytes.reserve(hex.size() / 2);
+   for (size_t i = 0; i < hex.size(); i += 2) {
+      if (!std::isxdigit(static_cast<unsigned char>(hex[i])) || !std::isxdigit(static_cast<unsigned char>(hex[i + 1]))) {
+         return {};
+      }
+      bytes.push_back(static_cast<unsigned char>(hexDigitToInt(hex[i]) << 4 | hexDigitToInt(hex[i + 1])));
+   }
+   return bytes;
+}
+
+/// @brief Encode bytes as lowercase hex
+/// @param bytes Bytes to encode
+/// @return Hex string
+inline std::string hex_encode(const std::vector<unsigned char>& bytes) {
+   std::string hex;
+   hex.reserve(bytes.size() * 2);
+   for (auto byte : bytes) {
+      hex += std::format("{:02x}", byte);
+   }
+   return hex;
+}
+
+/// @brief Stable 64-bit FNV-1a hash, identical across processes and builds
+/// @param str String to hash
+/// @param seed Optional seed to derive independent hashes of the same string
+/// @return Hash value
+inline constexpr uint64_t fnv1a_hash(std::string_view str, uint64_t seed = 0) noexcept {
+   uint64_t hash = 14695981039346656037ull ^ seed;
+   for (char c : str) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 1099511628211ull;
+   }
+   return hash;
+}
+
 /// @brief Convert given string to uppercase
 /// @param str 
 /// @return New uppercased string
@@ -59,6 +105,21 @@ inline auto get_current_tz() {
    return std::chrono::current_zone();
 }
 
+/// @brief Look up an IANA time zone by name, falling back to the current time zone
+/// @param name Time zone name, e.g. "Australia/Sydney". Empty uses the current time zone.
+/// @return Time zone
+inline const std::chrono::time_zone* get_tz_or_current(const std::string& name) {
+   if (!name.empty()) {
+      try {
+         return std::chrono::locate_zone(name);
+      } catch (std::runtime_error&) {
+         spdlog::warn("Unknown time zone '{}', defaulting to the current time zone", name);
+      }
+   }
+
+   return get_current_tz();
+}
+
 /// @brief Get the current day as a year_month_day object
 /// @return Current day as a year_month_day object
 inline std::chrono::year_month_day get_today_as_ymd() {
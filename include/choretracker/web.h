@@ -3,37 +3,139 @@
 #include <crow.h>
 #include <crow/middlewares/cors.h>
 #include <crow/middlewares/cookie_parser.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <optional>
 
+#include "choretracker/bot.h"
+#include "choretracker/concurrency_limit.h"
 #include "choretracker/db.h"
 #include "choretracker/discord_oauth.h"
+#include "choretracker/interactions.h"
+#include "choretracker/rate_limit.h"
+#include "choretracker/task_events.h"
+#include "choretracker/write_queue.h"
 
-#define DEFAULT_WEB_PORT 8080
-#define DEFAULT_WEB_BASE_URL "http://localhost:" STRINGIFY(DEFAULT_WEB_PORT)
+#define SESSION_TTL std::chrono::days(30)
+#define MAX_TASK_PAGE_SIZE 500
+// Exports are spooled here (under the temp dir, suffixed with the user id) while they stream out
+#define EXPORT_SPOOL_DIR "choretracker-exports"
+#define EXPORT_SPOOL_TTL std::chrono::minutes(15)
+// Several users can share an address (NAT, offices), so the per-address bucket is this many times the per-user one
+#define WEB_RATE_LIMIT_IP_MULTIPLIER 4
+
+/// @brief Records each request's route, status and timing to the workload trace when capturing
+struct TraceCapture {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+/// @brief Tracks in-flight requests, and turns new ones away once draining
+struct DrainGuard {
+    struct context {
+        bool counted = false;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+
+    std::atomic<bool> draining = false;
+    std::atomic<int> in_flight = 0;
+};
+
+/// @brief Token buckets on API routes, per client address and then per signed in user
+///
+/// The address bucket is taken before the session is looked up, so made up cookies
+/// can't get a flood through to the DB.
+struct RateLimitGuard {
+    struct context {
+        // Session looked up for the user's bucket, reused by check_auth
+        bool resolved = false;
+        std::optional<user_session> session;
+    };
+
+    RateLimitGuard() : ip_limiter("web_ip"), user_limiter("web") {}
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx) {}
+
+    RateLimiter ip_limiter;
+    RateLimiter user_limiter;
+    // Set by Web, resolves a session cookie
+    std::function<std::optional<user_session>(const std::string&)> find_session;
+};
+
+/// @brief Sheds requests with a 503 once more are in flight than the DB is keeping up with
+struct ConcurrencyGuard {
+    struct context {
+        bool admitted = false;
+        // DB time this worker thread had already racked up when the request started
+        std::chrono::steady_clock::duration db_time_at_start{};
+    };
+
+    ConcurrencyGuard() : limiter("web") {}
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+
+    ConcurrencyLimiter limiter;
+};
 
 class Web {
     public:
         Web(int port, const std::string& base_url, const std::string& client_id, 
-                const std::string& client_secret, Database& db) 
-                : oauth(client_id, client_secret, base_url + "/auth/callback"), db(db) {
+                const std::string& client_secret, const std::optional<std::string>& interactions_public_key,
+                Database& db, TaskEventHub& events, TaskWriter& writer, Bot* bot) 
+                : oauth(client_id, client_secret, base_url + "/auth/callback"), db(db), events(events), writer(writer), bot(bot) {
+            if (interactions_public_key.has_value()) {
+                interactions = std::make_unique<InteractionVerifier>(interactions_public_key.value());
+            }
             init(base_url, port);
         }
         ~Web();
 
+        void drain(std::chrono::seconds timeout, std::chrono::seconds grace);
+        void stop();
+
         std::future<void> running_future;
     private:
         void init(const std::string& base_url, int port);
         std::optional<user_session> check_auth(const crow::request& req);
+        std::optional<user_session> find_session(const std::string& session_cookie);
+        void set_session_cookie(const crow::request& req, const std::string& session_cookie);
 
         crow::response auth_callback(const crow::request& req, const std::string& code);
+        crow::response auth_logout(const crow::request& req);
         crow::response user_get(const user_session& user_session);
-        crow::response tasks_list(const std::string& user_id);
-        crow::response tasks_add(const std::string& user_id, const std::string& task_name, task_type task_type, int32_t task_frequency);
+        crow::response user_settings_get(const std::string& user_id);
+        crow::response user_settings_set(const std::string& user_id, const std::string& alert_time, const std::string& time_zone);
+        crow::response tasks_list(const std::string& user_id, const task_query& query);
+        crow::response tasks_add(const std::string& user_id, const std::string& task_name, task_type task_type, int32_t task_frequency,
+            std::shared_ptr<const Recurrence> recurrence);
         crow::response tasks_delete(const std::string& user_id, const std::string& task_name);
         crow::response tasks_complete(const std::string& user_id, const std::string& task_name);
+        crow::response tasks_export(const std::string& user_id);
+        crow::response tasks_import(const std::string& user_id, const std::string& body);
+        crow::response tasks_stats(const std::string& user_id, const std::string& task_name);
+        void interactions_handle(const crow::request& req, crow::response& res);
 
-        crow::App<crow::CORSHandler, crow::CookieParser> server;
+        // Middlewares run in this order. Load is shed before anything touches the DB, so the
+        // rate limiter's session lookup only happens for requests holding a concurrency slot
+        crow::App<TraceCapture, crow::CORSHandler, crow::CookieParser, DrainGuard, ConcurrencyGuard, RateLimitGuard> server;
+        bool stopped = false;
         DiscordOAuth oauth;
         Database& db;
+        TaskEventHub& events;
+        TaskWriter& writer;
+        // Handles commands arriving over the interactions endpoint, null if this process doesn't run a bot
+        Bot* bot;
+        // Only set when Discord is configured to deliver interactions over HTTP
+        std::unique_ptr<InteractionVerifier> interactions;
 
 };
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "choretracker/db.h"
+#include "choretracker/metrics.h"
+#include "choretracker/task_events.h"
+
+// Start a new segment file once the current one passes this size
+#define WRITE_QUEUE_SEGMENT_BYTES (4 * 1024 * 1024)
+// How long to wait before retrying Mongo after a failed write
+#define WRITE_QUEUE_RETRY_INTERVAL std::chrono::seconds(2)
+
+enum class write_result {
+    // Written to Mongo
+    applied,
+    // Mongo said no, e.g. the task doesn't exist
+    rejected,
+    // Mongo is unavailable, saved to disk and will be applied once it's back
+    queued
+};
+
+/// @brief Applies task writes to Mongo, falling back to an fsync'd local queue during outages
+///
+/// While Mongo is healthy and nothing is queued, writes go straight through. Once a
+/// write fails, it and every write after it are appended to a segment file on disk
+/// and acknowledged, and a background thread replays them in order once Mongo is
+/// back. Replays carry an idempotency key, so a write that reached Mongo before a
+/// crash isn't applied twice. Only outages are queued: a write Mongo refuses is
+/// rejected up front, or set aside in a dead letter file if it's refused on replay.
+class TaskWriter {
+    public:
+        /// @param directory Where segment files are kept, created if missing. Fails if another
+        /// process is already using it
+        TaskWriter(Database& db, TaskEventHub& events, const std::filesystem::path& directory);
+        ~TaskWriter();
+
+        write_result add_task(const task_definition& task);
+        write_result complete_task(const dpp::snowflake& user_id, const std::string& task_name);
+        write_result delete_task(const dpp::snowflake& user_id, const std::string& task_name);
+
+        /// @brief Stop replaying, anything still queued stays on disk for next start
+        void stop();
+    private:
+        write_result submit(task_mutation mutation);
+        void append(task_mutation& mutation);
+        void recover();
+        void write_checkpoint(uint64_t sequence);
+        void dead_letter(const task_mutation& mutation, const std::string& error);
+        void remove_replayed_segments(uint64_t sequence);
+        void update_lag();
+        void thread_task();
+
+        Database& db;
+        TaskEventHub& events;
+        std::filesystem::path directory;
+        // Holds an exclusive flock on the directory for as long as we use it
+        int lock_fd = -1;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<task_mutation> pending;
+        uint64_t next_sequence = 1;
+        int segment_fd = -1;
+        uint64_t segment_size = 0;
+        std::mt19937 generator;
+        bool healthy = true;
+        bool stopping = false;
+        std::thread thread;
+
+        Metric& depth;
+        Metric& lag_seconds;
+        Metric& queued_total;
+        Metric& replayed_total;
+        Metric& replay_failures_total;
+        Metric& dead_lettered_total;
+};
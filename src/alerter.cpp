@@ -1,32 +1,78 @@
+#include <algorithm>
 #include <chrono>
-#include <format>
+#include <map>
 #include <spdlog/spdlog.h>
 
 #include "choretracker/alerter.h"
+#include "choretracker/render.h"
 #include "choretracker/utils.hpp"
 
-auto get_next_alert_time() {
-   const auto now = std::chrono::system_clock::now();
-   const auto zone = get_current_tz();
-   const auto local_now = zone->to_local(now);
+// How often to reload users and their settings into the schedule
+#define SCHEDULE_REFRESH_INTERVAL std::chrono::minutes(5)
+// Pause between batches when many users come due at once
+#define ALERT_BATCH_INTERVAL std::chrono::seconds(1)
+// How often to check for /runalerts taken by other processes
+#define ALERT_RUN_REQUEST_POLL_INTERVAL std::chrono::seconds(2)
 
-   // Run alerts at 6:00
-   auto next_alert_time = floor<std::chrono::days>(local_now) + std::chrono::hours(6);
-   if (zone->to_sys(next_alert_time) < now) {
-      next_alert_time += std::chrono::days(1);
+/// @brief Get the user-local date for a given instant
+std::chrono::year_month_day get_local_date(const user_settings& settings, std::chrono::system_clock::time_point now) {
+   const auto zone = get_tz_or_current(settings.time_zone);
+   return std::chrono::year_month_day{ std::chrono::floor<std::chrono::days>(zone->to_local(now)) };
+}
+
+/// @brief Get the next time a user should be alerted, given their settings
+/// @param settings Must hold last_alerted as the claims left it, or users already alerted today would be caught up again
+std::chrono::system_clock::time_point get_next_alert_time(const user_settings& settings, std::chrono::system_clock::time_point now) {
+   const auto zone = get_tz_or_current(settings.time_zone);
+   const auto local_midnight = std::chrono::floor<std::chrono::days>(zone->to_local(now));
+
+   // Anyone claimed for today is done until tomorrow, whatever time it is now
+   auto alert_time = local_midnight + std::chrono::minutes(settings.alert_minutes);
+   if (settings.last_alerted == std::chrono::year_month_day{ local_midnight }) {
+      alert_time += std::chrono::days(1);
    }
 
-   return zone->to_sys(next_alert_time);
+   // Only a user with no claim for today can get here with their time passed, e.g. the
+   // node that owned them was down at the time, so catch them up now
+   auto next_alert_time = std::chrono::system_clock::time_point(zone->to_sys(alert_time, std::chrono::choose::earliest));
+   return std::max(next_alert_time, now);
 }
 
 void Alerter::begin() {
+   dispatcher.begin();
    thread = std::thread(&Alerter::thread_task, this);
    spdlog::info("Alerting thread started");
 }
 
-void Alerter::run_alerts() {
-   auto now = std::chrono::sys_days(get_today_as_ymd());
-   spdlog::debug(std::format("Running alerts: now=\"{}\"", now));
+/// @brief Stop scheduling alerts, flush queued DMs and hand our partitions to other nodes
+/// @param timeout Longest to wait for queued DMs to go out
+void Alerter::stop(std::chrono::seconds timeout) {
+   if (!thread.joinable()) {
+      return;
+   }
+
+   {
+      std::lock_guard lock(stop_mutex);
+      stopping = true;
+   }
+   stop_cv.notify_all();
+   thread.join();
+
+   // Claims for anything still queued are released, so the run picks up where it left off
+   dispatcher.stop(timeout);
+   partitions.leave();
+   spdlog::info("Alerting thread stopped");
+}
+
+/// @brief Alert every user now, whatever their schedule
+/// @param progress Told how many users have been handled so far
+void Alerter::run_alerts(const std::function<void(size_t done, size_t total)>& progress) {
+   spdlog::debug("Running alerts for all users");
+
+   std::map<std::string, user_settings> settings_by_user;
+   for (auto settings : db.list_user_settings()) {
+      settings_by_user[settings.user_id] = settings;
+   }
 
    // Map tasks to their respective users
    std::map<dpp::snowflake, std::vector<task_definition>> tasks_by_user;
@@ -36,65 +82,127 @@ void Alerter::run_alerts() {
    }
 
    // Send alerts per user
+   auto now = std::chrono::system_clock::now();
+   size_t done = 0;
    for (const auto& pair : tasks_by_user) {
-      auto user_id = pair.first;
-      auto user_tasks = pair.second;
-
-      // Determine which tasks are due
-      std::vector<std::string> one_off_messages;
-      std::vector<std::string> repeated_messages;
-      for (auto task : user_tasks) {
-         switch (task.type) {
-            case task_type::once_off:
-               one_off_messages.push_back(std::format("* {}", task.name));
-               break;
-            case task_type::regular: {
-               auto next_expected_time = std::chrono::sys_days(task.last_completed) + std::chrono::days(task.frequency_days);
-               if (next_expected_time == now) {
-                  repeated_messages.push_back(std::format("* {}", task.name));
-               } else if (next_expected_time < now) {
-                  repeated_messages.push_back(std::format("* {} - {} days late", task.name, (now - next_expected_time).count()));
-               } else {
-                  spdlog::debug(std::format("Not alerting: name=\"{}\" last_completed=\"{}\" deadline=\"{}\"", 
-                     task.name, task.last_completed, next_expected_time));
-               }
-               break;
-            }
-            default:
-               spdlog::warn(std::format("Unsupported task type: name=\"{}\"", task.name));
-         }
+      auto settings_it = settings_by_user.find(pair.first.str());
+      auto settings = settings_it != settings_by_user.end() ? settings_it->second : user_settings{ pair.first.str() };
+
+      send_alert(pair.first, pair.second, std::chrono::sys_days(get_local_date(settings, now)));
+      if (progress) {
+         progress(++done, tasks_by_user.size());
       }
+   }
+}
 
-      // Send alert if there are any due tasks
-      if (!one_off_messages.empty() || !repeated_messages.empty()) {
-         std::string alert_message = "You have the following tasks due:\n";
-         for (const auto& msg : repeated_messages) {
-            alert_message += msg + "\n";
-         }
-         if (!one_off_messages.empty()) {
-            if (!repeated_messages.empty()) {
-               alert_message += "\n";
-            }
-            alert_message += "One-off tasks:\n";
-            for (const auto& msg : one_off_messages) {
-               alert_message += msg + "\n";
-            }
-         }
+void Alerter::rebuild_schedule() {
+   auto now = std::chrono::system_clock::now();
+
+   std::map<std::string, user_settings> settings_by_user;
+   for (auto settings : db.list_user_settings()) {
+      settings_by_user[settings.user_id] = settings;
+   }
 
-         spdlog::info(std::format("Sending alert to user_id='{}'", user_id.str()));
-         bot.direct_message_create(user_id, dpp::message(alert_message));
+   scheduler.clear();
+   for (const auto& user_id : db.list_task_owners()) {
+      if (!partitions.owns_user(dpp::snowflake(user_id))) {
+         continue;
+      }
+
+      auto settings_it = settings_by_user.find(user_id);
+      auto settings = settings_it != settings_by_user.end() ? settings_it->second : user_settings{ user_id };
+      scheduler.schedule(user_id, get_next_alert_time(settings, now));
+   }
+
+   spdlog::debug("Alert schedule rebuilt: users={}", scheduler.size());
+}
+
+void Alerter::alert_scheduled_user(const std::string& user_id) {
+   // Partitions may have moved since the user was scheduled
+   if (!partitions.owns_user(dpp::snowflake(user_id))) {
+      return;
+   }
+
+   auto now = std::chrono::system_clock::now();
+   auto settings = db.get_user_settings(user_id).value_or(user_settings{ user_id });
+   auto local_today = get_local_date(settings, now);
+
+   // Claiming guards against double alerts across partition handovers
+   if (db.claim_user_alert(user_id, local_today)) {
+      send_alert(dpp::snowflake(user_id), db.list_tasks_by_user(dpp::snowflake(user_id)), std::chrono::sys_days(local_today), local_today);
+   }
+
+   settings.last_alerted = local_today;
+   scheduler.schedule(user_id, get_next_alert_time(settings, now));
+}
+
+void Alerter::send_alert(const dpp::snowflake& user_id, const std::vector<task_definition>& user_tasks, std::chrono::sys_days now,
+      const std::optional<std::chrono::year_month_day>& claim_date) {
+   // Send alert if there are any due tasks
+   auto messages = render_alert(user_tasks, now);
+   if (!messages.empty()) {
+      spdlog::info("Queueing alert for user_id='{}' messages={}", user_id.str(), messages.size());
+      for (const auto& message : messages) {
+         dispatcher.enqueue(user_id, dpp::message(message), claim_date);
       }
    }
 }
 
 void Alerter::thread_task() {
-   spdlog::debug(std::format("Current TZ in alerter thread: {}", get_current_tz()->name()));
+   spdlog::debug("Current TZ in alerter thread: {}", get_current_tz()->name());
 
-   while (true) {
-      auto time_to_sleep_until = get_next_alert_time();
-      spdlog::debug(std::format("Sleeping until {}", get_current_tz()->to_local(time_to_sleep_until)));
-      std::this_thread::sleep_until(time_to_sleep_until);
+   auto next_heartbeat = std::chrono::system_clock::time_point::min();
+   auto next_refresh = std::chrono::system_clock::time_point::min();
+   auto next_request_poll = std::chrono::system_clock::time_point::min();
+   std::unique_lock lock(stop_mutex);
+   while (!stopping) {
+      // Alert work happens unlocked, stopping is checked between batches
+      lock.unlock();
+      auto now = std::chrono::system_clock::now();
 
-      run_alerts();
+      auto wake_time = now;
+      try {
+         bool partitions_changed = false;
+         if (now >= next_heartbeat) {
+            partitions_changed = partitions.heartbeat();
+            next_heartbeat = now + partitions.heartbeat_interval();
+         }
+         if (partitions_changed || now >= next_refresh) {
+            rebuild_schedule();
+            next_refresh = now + SCHEDULE_REFRESH_INTERVAL;
+         }
+         if (run_requested && now >= next_request_poll) {
+            while (auto request = db.claim_alert_run_request(partitions.get_node_id())) {
+               run_requested(request.value());
+            }
+            next_request_poll = now + ALERT_RUN_REQUEST_POLL_INTERVAL;
+         }
+
+         // Work through whoever is due in small batches, spreading load through the day
+         size_t batch_size = config_get()->alert_batch_size;
+         auto due_users = scheduler.pop_due(now, batch_size);
+         for (const auto& user_id : due_users) {
+            alert_scheduled_user(user_id);
+         }
+         wake_time = std::min({ next_heartbeat, next_refresh, scheduler.next_due().value_or(next_heartbeat) });
+         if (run_requested) {
+            wake_time = std::min(wake_time, next_request_poll);
+         }
+         if (due_users.size() == batch_size) {
+            wake_time = std::chrono::system_clock::now() + ALERT_BATCH_INTERVAL;
+         }
+      } catch (const std::exception& e) {
+         // Most likely Mongo failing over. Our leases can't be renewed meanwhile, so stop
+         // working our partitions and try again at the next heartbeat
+         spdlog::error("Alerter loop failed, retrying at next heartbeat: {}", e.what());
+         if (partitions.drop()) {
+            scheduler.clear();
+         }
+         next_heartbeat = now + partitions.heartbeat_interval();
+         wake_time = next_heartbeat;
+      }
+
+      lock.lock();
+      stop_cv.wait_until(lock, wake_time, [this]() { return stopping; });
    }
-}
\ No newline at end of file
+}
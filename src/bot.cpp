@@ -1,17 +1,158 @@
 #include <format>
+#include <map>
+#include <string_view>
 
 #include <spdlog/spdlog.h>
 
 #include "choretracker/bot.h"
+#include "choretracker/capture.h"
 #include "choretracker/config.h"
+#include "choretracker/metrics.h"
+#include "choretracker/render.h"
 #include "choretracker/utils.hpp"
 
-void list_tasks(Database &db, const dpp::slashcommand_t &event);
-void add_task(Database &db, const dpp::slashcommand_t &event);
-void delete_task(Database &db, const dpp::slashcommand_t &event);
-void complete_task(Database &db, const dpp::slashcommand_t &event);
+void list_tasks(Database &db, dpp::cluster &cluster, const dpp::interaction &command, const command_responder &respond);
+void add_task(TaskWriter &writer, TaskEventHub &events, const dpp::interaction &command, const command_responder &respond);
+void delete_task(TaskWriter &writer, TaskEventHub &events, const dpp::interaction &command, const command_responder &respond);
+void complete_task(TaskWriter &writer, TaskEventHub &events, const dpp::interaction &command, const command_responder &respond);
+std::string format_job_status(const job_status& status);
+void capture_interaction(trace_kind kind, const dpp::interaction &command, std::chrono::steady_clock::time_point started, uint16_t status);
+
+/// @brief Whether REST calls to Discord are stubbed out, logging the call that was skipped
+static bool discord_rest_stubbed(const char* call) {
+    if (!config_get()->discord_rest_stubbed) {
+        return false;
+    }
+    spdlog::debug("Discord REST call stubbed: call='{}'", call);
+    return true;
+}
+
+/// @brief Send a message to an interaction's webhook, naming the application explicitly
+///
+/// D++'s own interaction calls take the application from cluster.me, which is only set by a
+/// gateway READY, so REST-only processes (and alert runs handed over from them) would have none
+/// @param path Token, plus "/messages/@original" to edit the reply
+/// @param callback Given the HTTP result, if set
+static void interaction_webhook(dpp::cluster& cluster, const dpp::snowflake& application_id, const std::string& path, dpp::http_method method,
+        const dpp::message& message, std::function<void(const dpp::http_request_completion_t&)> callback = nullptr) {
+    cluster.post_rest(DISCORD_API_PATH "/webhooks", application_id.str(), path, method, message.build_json(),
+        [callback = std::move(callback)](dpp::json&, const dpp::http_request_completion_t& http) {
+            if (callback) {
+                callback(http);
+            }
+        });
+}
+
+/// @brief Parse a comma separated list of gateway intent names
+/// @return Intent bits, unknown names are logged and skipped
+uint32_t gateway_intents_from_string(const std::string& intents) {
+    static const std::map<std::string, uint32_t> intent_names = {
+        { "guilds", dpp::i_guilds },
+        { "guild_members", dpp::i_guild_members },
+        { "guild_messages", dpp::i_guild_messages },
+        { "guild_message_reactions", dpp::i_guild_message_reactions },
+        { "guild_presences", dpp::i_guild_presences },
+        { "guild_voice_states", dpp::i_guild_voice_states },
+        { "direct_messages", dpp::i_direct_messages },
+        { "direct_message_reactions", dpp::i_direct_message_reactions },
+        { "message_content", dpp::i_message_content },
+        { "default", dpp::i_default_intents }
+    };
+
+    uint32_t result = 0;
+    std::string_view remaining(intents);
+    while (!remaining.empty()) {
+        auto end = remaining.find(',');
+        std::string name(remaining.substr(0, end));
+        remaining = end == std::string_view::npos ? std::string_view() : remaining.substr(end + 1);
+        if (name.empty()) {
+            continue;
+        }
+
+        auto it = intent_names.find(name);
+        if (it != intent_names.end()) {
+            result |= it->second;
+        } else {
+            spdlog::warn("Unknown gateway intent: intent='{}'", name);
+        }
+    }
+    return result;
+}
+
+/// @brief Count an event type that arrives on the gateway but isn't used
+template <typename T>
+void count_discarded_event(dpp::event_router_t<T>& router, const std::string& name) {
+    auto& received = metrics_counter(std::format("gateway_events_received_total{{event=\"{}\"}}", name), "Gateway events received");
+    auto& discarded = metrics_counter(std::format("gateway_events_discarded_total{{event=\"{}\"}}", name), "Gateway events received and ignored");
+    router([&received, &discarded](const T&) {
+        received.inc();
+        discarded.inc();
+    });
+}
+
+/// @brief Track what the gateway sends us, so intents left wider than needed show up
+void Bot::count_gateway_events() {
+    auto& ready_received = metrics_counter("gateway_events_received_total{event=\"ready\"}", "Gateway events received");
+    auto& command_received = metrics_counter("gateway_events_received_total{event=\"slashcommand\"}", "Gateway events received");
+    auto& autocomplete_received = metrics_counter("gateway_events_received_total{event=\"autocomplete\"}", "Gateway events received");
+    cluster.on_ready([&ready_received](const dpp::ready_t&) { ready_received.inc(); });
+    cluster.on_slashcommand([&command_received](const dpp::slashcommand_t&) { command_received.inc(); });
+    cluster.on_autocomplete([&autocomplete_received](const dpp::autocomplete_t&) { autocomplete_received.inc(); });
+
+    // Nothing here needs these, they only arrive if the configured intents ask for them
+    count_discarded_event(cluster.on_guild_create, "guild_create");
+    count_discarded_event(cluster.on_guild_update, "guild_update");
+    count_discarded_event(cluster.on_guild_delete, "guild_delete");
+    count_discarded_event(cluster.on_channel_create, "channel_create");
+    count_discarded_event(cluster.on_channel_update, "channel_update");
+    count_discarded_event(cluster.on_channel_delete, "channel_delete");
+    count_discarded_event(cluster.on_guild_member_add, "guild_member_add");
+    count_discarded_event(cluster.on_guild_member_update, "guild_member_update");
+    count_discarded_event(cluster.on_guild_member_remove, "guild_member_remove");
+    count_discarded_event(cluster.on_presence_update, "presence_update");
+    count_discarded_event(cluster.on_voice_state_update, "voice_state_update");
+    count_discarded_event(cluster.on_message_create, "message_create");
+    count_discarded_event(cluster.on_message_update, "message_update");
+    count_discarded_event(cluster.on_message_delete, "message_delete");
+    count_discarded_event(cluster.on_message_reaction_add, "message_reaction_add");
+    count_discarded_event(cluster.on_typing_start, "typing_start");
+}
 
 void Bot::init() {
+    cluster.on_log([](const dpp::log_t &log) {
+        switch (log.severity) {
+            case dpp::ll_info:
+                spdlog::info("Discord: {}", log.message);
+                break;
+            case dpp::ll_warning:
+                spdlog::warn("Discord: {}", log.message);
+                break;
+            case dpp::ll_error:
+            case dpp::ll_critical:
+                spdlog::error("Discord: {}", log.message);
+                break;
+            default:
+                break;
+        }
+    });
+
+    if (roles.alerting) {
+        // /runalerts taken by web or bot processes in a split deployment
+        alerter.on_run_requested([this](const alert_run_request& request) {
+            start_alert_run(request.application_id, request.interaction_token);
+        });
+    }
+
+    if (!roles.gateway) {
+        // REST calls (alert DMs, interaction follow-ups) work without a gateway connection
+        if (roles.alerting) {
+            alerter.begin();
+        }
+        return;
+    }
+
+    count_gateway_events();
+
     cluster.on_ready([this](const dpp::ready_t &event) {
         spdlog::info("Discord connected");
 
@@ -46,8 +187,9 @@ void Bot::init() {
             reset_task_command.add_option(
                 dpp::command_option(dpp::co_string, "name", "Name of task", true).set_auto_complete(true));
 
-            if (config_get_bool(CONFIG_REGISTER_COMMANDS).value_or(false)) {
-                auto test_guild = config_get_str(CONFIG_TEST_GUILD);
+            auto config = config_get();
+            if (config->register_commands) {
+                auto test_guild = config->test_guild;
                 if (test_guild.has_value()) {
                     // Command only available when testing in a guild
                     dpp::slashcommand run_alerts_command("runalerts", "Run alerts for tasks", cluster.me.id);
@@ -55,7 +197,7 @@ void Bot::init() {
                     cluster.guild_bulk_command_create({
                         list_tasks_command, add_tasks_command, delete_tasks_command, reset_task_command, run_alerts_command
                     }, test_guild.value());
-                    spdlog::info(std::format("Discord commands registered to guild: guildId={}", test_guild.value()));
+                    spdlog::info("Discord commands registered to guild: guildId={}", test_guild.value());
                 } else {
                     cluster.global_bulk_command_create({
                         list_tasks_command, add_tasks_command, delete_tasks_command, reset_task_command
@@ -68,182 +210,339 @@ void Bot::init() {
         }
 
         // Start alerting thread
-        if (dpp::run_once<struct start_alert_threads>()) {
+        if (roles.alerting && dpp::run_once<struct start_alert_threads>()) {
             alerter.begin();
         }
     });
 
-    cluster.on_log([](const dpp::log_t &log) {
-        switch (log.severity) {
-            case dpp::ll_info:
-                spdlog::info("Discord: " + log.message);
-                break;
-            case dpp::ll_warning:
-                spdlog::warn("Discord: " + log.message);
-                break;
-            case dpp::ll_error:
-            case dpp::ll_critical:
-                spdlog::error("Discord: " + log.message);
-                break;
-            default:
-                break;
-        }
+    cluster.on_slashcommand([this](const dpp::slashcommand_t &event) {
+        handle_command(event.command, [event](const dpp::message& message, const std::function<void()>& on_sent) {
+            event.reply(message, [on_sent](const dpp::confirmation_callback_t& result) {
+                if (!result.is_error() && on_sent) {
+                    on_sent();
+                }
+            });
+        });
     });
 
-    cluster.on_slashcommand([this](const dpp::slashcommand_t &event) {
-        auto command_name = event.command.get_command_name();
-        spdlog::info(std::format("Command received: command='{}' user='{}'", command_name, event.command.usr.username));
-        if (command_name == "listtasks") {
-            list_tasks(db, event);
-        } else if (command_name == "addtask") {
-            add_task(db, event);
-        } else if (command_name == "deletetask") {
-            delete_task(db, event);
-        } else if (command_name == "resettask") {
-            complete_task(db, event);
-        } else if (command_name == "runalerts") {
-            alerter.run_alerts();
-        } else {
-            spdlog::error("Unknown command received");
+    cluster.on_autocomplete([this](const dpp::autocomplete_t &event) {
+        auto resp = handle_autocomplete(event.command);
+        if (resp.has_value()) {
+            cluster.interaction_response_create(event.command.id, event.command.token, resp.value());
         }
     });
 
-    cluster.on_autocomplete([this](const dpp::autocomplete_t &event) {
-        spdlog::info(std::format("Autocomplete triggered for command: command='{}' user='{}'", event.name, event.command.usr.username));
-        
-        std::optional<dpp::command_option> o_focused_opt;
-        for (auto &opt : event.options) {
-            if (opt.focused) {
-                o_focused_opt = opt;
-            }
+    // Start the bot itself
+    cluster.start(dpp::st_return);
+}
+
+/// @brief Run a slash command, wherever it came in from
+/// @param command Parsed interaction
+/// @param respond Sends the reply back the way the command came in
+void Bot::handle_command(const dpp::interaction& command, const command_responder& respond) {
+    auto started = std::chrono::steady_clock::now();
+    auto command_name = command.get_command_name();
+    spdlog::info("Command received: command='{}' user='{}'", command_name, command.usr.username);
+
+    auto retry_after = rate_limit(command.usr.id);
+    if (retry_after.has_value()) {
+        auto retry_seconds = std::chrono::ceil<std::chrono::seconds>(retry_after.value());
+        respond(dpp::message(std::format("Slow down, try again in {} seconds", retry_seconds.count())).set_flags(dpp::m_ephemeral), nullptr);
+        capture_interaction(trace_kind::command, command, started, 1);
+        return;
+    }
+    if (command_name == "listtasks") {
+        list_tasks(db, cluster, command, respond);
+    } else if (command_name == "addtask") {
+        add_task(*writer, events, command, respond);
+    } else if (command_name == "deletetask") {
+        delete_task(*writer, events, command, respond);
+    } else if (command_name == "resettask") {
+        complete_task(*writer, events, command, respond);
+    } else if (command_name == "runalerts") {
+        run_alerts(command, respond);
+    } else {
+        spdlog::error("Unknown command received");
+    }
+    capture_interaction(trace_kind::command, command, started, 0);
+}
+
+/// @brief Queue an alert run off the event thread, updating the reply as it goes
+void Bot::run_alerts(const dpp::interaction& command, const command_responder& respond) {
+    if (!roles.alerting) {
+        // Alerts run in another process, which picks this up and edits the reply from there
+        if (!db.request_alert_run({ command.token, command.application_id })) {
+            respond(dpp::message("Unable to queue an alert run, try again").set_flags(dpp::m_ephemeral), nullptr);
+            return;
         }
+        respond(dpp::message("Alert run requested").set_flags(dpp::m_ephemeral), nullptr);
+        return;
+    }
+
+    respond(dpp::message("Alert run queued").set_flags(dpp::m_ephemeral), [this, application_id = command.application_id, token = command.token]() {
+        start_alert_run(application_id, token);
+    });
+}
 
-        if (!o_focused_opt.has_value()) {
-            spdlog::warn("Autocomplete command had no focused opt?");
+/// @brief Run alerts as a background job, editing an interaction's reply as it goes
+/// @param application_id Taken from the interaction, as cluster.me is only filled in by a gateway READY
+void Bot::start_alert_run(const dpp::snowflake& application_id, const std::string& interaction_token) {
+    jobs.submit("run_alerts", [this](const job_progress& progress) {
+        alerter.run_alerts(progress);
+    }, [this, application_id, interaction_token](const job_status& status) {
+        if (discord_rest_stubbed("interaction_response_edit")) {
             return;
         }
+        interaction_webhook(cluster, application_id, dpp::utility::url_encode(interaction_token) + "/messages/@original", dpp::m_patch,
+            dpp::message(format_job_status(status)).set_flags(dpp::m_ephemeral));
+    });
+}
+
+/// @brief Suggest task names for the focused option
+/// @return Response to send, or empty if there's nothing to suggest
+std::optional<dpp::interaction_response> Bot::handle_autocomplete(const dpp::interaction& command) {
+    auto started = std::chrono::steady_clock::now();
+    spdlog::info("Autocomplete triggered for command: command='{}' user='{}'", command.get_command_name(), command.usr.username);
+
+    std::optional<dpp::command_data_option> o_focused_opt;
+    for (auto &opt : command.get_command_interaction().options) {
+        if (opt.focused) {
+            o_focused_opt = opt;
+        }
+    }
 
-        auto user_id = event.command.usr.id;
-        auto focused_opt = o_focused_opt.value();
-        if (focused_opt.name == "name") {
-            std::string value = std::get<std::string>(focused_opt.value);
-            dpp::interaction_response resp(dpp::ir_autocomplete_reply);
+    if (!o_focused_opt.has_value()) {
+        spdlog::warn("Autocomplete command had no focused opt?");
+        return {};
+    }
 
-            std::vector<task_definition> tasks;
-            if (value.empty()) {
-                tasks = db.list_tasks_by_user(user_id);
-            } else {
-                tasks = db.find_tasks_by_name(user_id, value);
-            }
-            for (auto task : tasks) {
-                resp.add_autocomplete_choice(dpp::command_option_choice(task.name, task.name));
-            }
+    auto user_id = command.usr.id;
+    if (rate_limit(user_id).has_value()) {
+        // Discord fires these on every keystroke, an empty reply keeps the client responsive
+        capture_interaction(trace_kind::autocomplete, command, started, 1);
+        return dpp::interaction_response(dpp::ir_autocomplete_reply);
+    }
+
+    auto focused_opt = o_focused_opt.value();
+    if (focused_opt.name != "name") {
+        return {};
+    }
+
+    std::string value = std::get<std::string>(focused_opt.value);
+    dpp::interaction_response resp(dpp::ir_autocomplete_reply);
+
+    std::vector<task_definition> tasks;
+    if (value.empty()) {
+        tasks = db.list_tasks_by_user(user_id);
+    } else {
+        tasks = db.find_tasks_by_name(user_id, value);
+    }
+    for (auto task : tasks) {
+        resp.add_autocomplete_choice(dpp::command_option_choice(task.name, task.name));
+    }
 
-            cluster.interaction_response_create(event.command.id, event.command.token, resp);
+    capture_interaction(trace_kind::autocomplete, command, started, 0);
+    return resp;
+}
+
+/// @brief Fill in a reply that was deferred, then run on_sent for any follow-ups
+void Bot::send_deferred_reply(const dpp::snowflake& application_id, const std::string& token, const dpp::message& message,
+        const std::function<void()>& on_sent, int attempt) {
+    // Discord only knows about the deferral once the HTTP response carrying it has gone out
+    auto delay = DEFERRED_REPLY_RETRY_DELAY * (1 << (attempt - 1));
+    deferred_replies.schedule(delay, [this, application_id, token, message, on_sent, attempt]() {
+        if (discord_rest_stubbed("interaction_response_edit")) {
+            on_sent();
+            return;
         }
+        interaction_webhook(cluster, application_id, dpp::utility::url_encode(token) + "/messages/@original", dpp::m_patch, message,
+            [this, application_id, token, message, on_sent, attempt](const dpp::http_request_completion_t& http) {
+                if (http.status == 404 && attempt < DEFERRED_REPLY_ATTEMPTS) {
+                    send_deferred_reply(application_id, token, message, on_sent, attempt + 1);
+                } else if (http.status == 0 || http.status >= 300) {
+                    spdlog::warn("Unable to send deferred interaction reply: status={} attempts={}", http.status, attempt);
+                } else {
+                    on_sent();
+                }
+            });
     });
+}
 
-    // Start the bot itself
-    cluster.start(dpp::st_return);
+/// @brief Take a token from the user's bucket
+/// @return Empty if allowed, otherwise how long until they can try again
+std::optional<std::chrono::milliseconds> Bot::rate_limit(const dpp::snowflake& user_id) {
+    auto config = config_get();
+    return limiter.acquire(user_id.str(), config->bot_rate_limit_per_second, config->bot_rate_limit_burst);
+}
+
+/// @brief Stop alerting and close the gateway connection
+/// @param timeout Longest to wait for queued alerts to go out
+void Bot::stop(std::chrono::seconds timeout) {
+    // Fill in the last deferred replies while REST calls still go out
+    deferred_replies.stop();
+    jobs.stop();
+    alerter.stop(timeout);
+    if (roles.gateway) {
+        cluster.shutdown();
+        spdlog::info("Discord disconnected");
+    }
 }
 
 /* Commands */
 
-void list_tasks(Database &db, const dpp::slashcommand_t &event) {
-    auto user_id = event.command.usr.id;
+/// @brief Describe a job's progress for a command reply
+std::string format_job_status(const job_status& status) {
+    auto seconds = std::chrono::duration<double>(status.elapsed).count();
+    switch (status.state) {
+        case job_state::queued:
+            return status.coalesced > 0 ? "Alert run already queued, joined it" : "Alert run queued";
+        case job_state::running:
+            if (status.total == 0) {
+                return std::format("Alert run in progress ({:.1f}s)", seconds);
+            }
+            return std::format("Alert run in progress: {}/{} users ({:.1f}s)", status.done, status.total, seconds);
+        case job_state::succeeded:
+            return std::format("Alert run finished: {} users in {:.1f}s", status.done, seconds);
+        case job_state::failed:
+            return std::format("Alert run failed after {:.1f}s: {}", seconds, status.error);
+    }
+    return "";
+}
 
-    auto tasks = db.list_tasks_by_user(user_id);
-    if (tasks.size() > 0) {
-        std::string task_list = "Tasks: \n";
-        std::string once_off_task_list = "Once off tasks: \n";
-
-        bool has_repeated_tasks = false;
-        bool has_once_off_tasks = false;
-
-        for (auto task : tasks) {
-            switch (task.type) {
-                case task_type::regular:
-                    task_list += std::format("{} - Every {} days - Last performed {}\n", 
-                        task.name, task.frequency_days, task.last_completed);
-                    has_repeated_tasks = true;
-                    break;
-                case task_type::counter:
-                    task_list += std::format("{} - Counter - Last performed {}\n", 
-                        task.name, task.frequency_days, task.last_completed);
-                    has_repeated_tasks = true;
-                    break;
-                case task_type::once_off:
-                    once_off_task_list += std::format("{}\n", task.name);
-                    has_once_off_tasks = true;
-                    break;
+/// @brief Find a command option by name, looking inside sub-commands
+dpp::command_value get_parameter(const dpp::interaction &command, const std::string &name) {
+    for (const auto &option : command.get_command_interaction().options) {
+        if (option.name == name) {
+            return option.value;
+        }
+        for (const auto &sub_option : option.options) {
+            if (sub_option.name == name) {
+                return sub_option.value;
             }
         }
+    }
+    return {};
+}
+
+/// @brief Record a command or autocomplete to the workload trace, if capturing
+/// @param status 0 if handled, 1 if turned away
+void capture_interaction(trace_kind kind, const dpp::interaction &command, std::chrono::steady_clock::time_point started, uint16_t status) {
+    if (!capture_enabled()) {
+        return;
+    }
 
-        std::string message;
-        if (has_repeated_tasks) {
-            message += task_list;
+    // Subcommands are part of the command's shape, e.g. "addtask regular"
+    std::string op = command.get_command_name();
+    uint32_t size = 0;
+    uint32_t object = 0;
+    for (const auto &option : command.get_command_interaction().options) {
+        if (option.type == dpp::co_sub_command) {
+            op += " " + option.name;
+            size += option.options.size();
+        } else {
+            size++;
         }
-        if (has_once_off_tasks) {
-            if (has_repeated_tasks) {
-                message += "\n";
-            }
-            message += once_off_task_list;
+        if (kind == trace_kind::autocomplete && option.focused && std::holds_alternative<std::string>(option.value)) {
+            size = std::get<std::string>(option.value).size();
+        }
+    }
+    if (kind == trace_kind::command) {
+        auto name = get_parameter(command, "name");
+        if (std::holds_alternative<std::string>(name)) {
+            object = capture_anonymize(std::get<std::string>(name));
         }
-        
-        event.reply(dpp::message(message).set_flags(dpp::m_ephemeral));
+    }
+
+    capture_record(kind, op, started, status, capture_anonymize(command.usr.id.str()), object, size);
+}
+
+void list_tasks(Database &db, dpp::cluster &cluster, const dpp::interaction &command, const command_responder &respond) {
+    auto user_id = command.usr.id;
+
+    auto tasks = db.list_tasks_by_user(user_id);
+    if (tasks.size() > 0) {
+        auto messages = render_task_list(tasks);
+
+        // Anything past Discord's message limit goes out as follow-ups
+        auto token = command.token;
+        auto application_id = command.application_id;
+        respond(dpp::message(messages[0]).set_flags(dpp::m_ephemeral), [&cluster, application_id, token, messages]() {
+            if (discord_rest_stubbed("interaction_followup_create")) {
+                return;
+            }
+            for (size_t i = 1; i < messages.size(); i++) {
+                interaction_webhook(cluster, application_id, dpp::utility::url_encode(token), dpp::m_post,
+                    dpp::message(messages[i]).set_flags(dpp::m_ephemeral));
+            }
+        });
     } else {
-        event.reply(dpp::message("No tasks found").set_flags(dpp::m_ephemeral));
+        respond(dpp::message("No tasks found").set_flags(dpp::m_ephemeral), nullptr);
     }
 }
 
-void add_task(Database &db, const dpp::slashcommand_t &event) {
-    auto user_id = event.command.usr.id;
-    auto guild_id = event.command.guild_id;
+void add_task(TaskWriter &writer, TaskEventHub &events, const dpp::interaction &command, const command_responder &respond) {
+    auto user_id = command.usr.id;
 
-    auto subcommand = event.command.get_command_interaction().options[0];
+    auto subcommand = command.get_command_interaction().options[0];
 
-    auto task_name = std::get<std::string>(event.get_parameter("name"));
+    auto task_name = std::get<std::string>(get_parameter(command, "name"));
     task_type type;
     int32_t frequency = 0;
 
     if (subcommand.name == "regular") {
         type = task_type::regular;
-        frequency = std::get<int64_t>(event.get_parameter("frequency"));
+        frequency = std::get<int64_t>(get_parameter(command, "frequency"));
     } else if (subcommand.name == "counter") {
         type = task_type::counter;
     } else if (subcommand.name == "once_off") {
         type = task_type::once_off;
     }
 
-    db.add_task({ 
+    auto result = writer.add_task({ 
         user_id,
         task_name,
         type,
         frequency,
         get_today_as_ymd() 
     });
-
-    event.reply(dpp::message("Task added").set_flags(dpp::m_ephemeral));
+    if (result == write_result::applied) {
+        events.publish(user_id.str(), { task_event_action::added, task_name });
+        respond(dpp::message("Task added").set_flags(dpp::m_ephemeral), nullptr);
+    } else if (result == write_result::queued) {
+        respond(dpp::message("Task added, it will show up shortly").set_flags(dpp::m_ephemeral), nullptr);
+    } else {
+        respond(dpp::message("Unable to add task, it may already exist").set_flags(dpp::m_ephemeral), nullptr);
+    }
 }
 
-void delete_task(Database &db, const dpp::slashcommand_t &event) {
-    auto user_id = event.command.usr.id;
+void delete_task(TaskWriter &writer, TaskEventHub &events, const dpp::interaction &command, const command_responder &respond) {
+    auto user_id = command.usr.id;
 
-    auto task_name = std::get<std::string>(event.get_parameter("name"));
+    auto task_name = std::get<std::string>(get_parameter(command, "name"));
 
-    bool deleted = db.delete_task(user_id, task_name);
-    if (deleted) {
-        event.reply(dpp::message("Task deleted").set_flags(dpp::m_ephemeral));
+    auto result = writer.delete_task(user_id, task_name);
+    if (result == write_result::applied) {
+        events.publish(user_id.str(), { task_event_action::deleted, task_name });
+        respond(dpp::message("Task deleted").set_flags(dpp::m_ephemeral), nullptr);
+    } else if (result == write_result::queued) {
+        respond(dpp::message("Task will be deleted shortly").set_flags(dpp::m_ephemeral), nullptr);
     } else {
-        event.reply(dpp::message("Task not found").set_flags(dpp::m_ephemeral));
+        respond(dpp::message("Task not found").set_flags(dpp::m_ephemeral), nullptr);
     }
 }
 
-void complete_task(Database &db, const dpp::slashcommand_t &event) {
-    auto user_id = event.command.usr.id;
+void complete_task(TaskWriter &writer, TaskEventHub &events, const dpp::interaction &command, const command_responder &respond) {
+    auto user_id = command.usr.id;
 
-    auto task_name = std::get<std::string>(event.get_parameter("name"));
+    auto task_name = std::get<std::string>(get_parameter(command, "name"));
 
-    db.complete_task(user_id, task_name);
-    event.reply(dpp::message("Task reset").set_flags(dpp::m_ephemeral));
-}
\ No newline at end of file
+    auto result = writer.complete_task(user_id, task_name);
+    if (result == write_result::applied) {
+        events.publish(user_id.str(), { task_event_action::completed, task_name });
+        respond(dpp::message("Task reset").set_flags(dpp::m_ephemeral), nullptr);
+    } else if (result == write_result::queued) {
+        respond(dpp::message("Task reset, it will show up shortly").set_flags(dpp::m_ephemeral), nullptr);
+    } else {
+        respond(dpp::message("Task not found").set_flags(dpp::m_ephemeral), nullptr);
+    }
+}
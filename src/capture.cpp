@@ -0,0 +1,248 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <spdlog/spdlog.h>
+
+#include "choretracker/capture.h"
+#include "choretracker/metrics.h"
+#include "choretracker/utils.hpp"
+
+struct capture_state {
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Encoded frames waiting to be written
+    std::string buffer;
+    std::unordered_map<std::string, uint32_t> names;
+    std::ofstream file;
+    uint64_t written = 0;
+    uint64_t max_bytes = 0;
+    bool stopping = false;
+    std::thread thread;
+    std::chrono::steady_clock::time_point start;
+    uint64_t salt = 0;
+};
+
+static std::atomic<bool> enabled = false;
+static std::unique_ptr<capture_state> state;
+
+/// @brief Append an unsigned LEB128 varint
+static void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static std::optional<uint64_t> get_varint(std::istream& in) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) {
+            return {};
+        }
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    return {};
+}
+
+/// @brief Write buffered frames out every CAPTURE_FLUSH_INTERVAL, and once more when stopping
+static void capture_thread_task() {
+    std::unique_lock lock(state->mutex);
+    while (true) {
+        state->cv.wait_for(lock, CAPTURE_FLUSH_INTERVAL, []() { return state->stopping; });
+
+        std::string pending;
+        pending.swap(state->buffer);
+        bool stopping = state->stopping;
+        lock.unlock();
+
+        if (!pending.empty()) {
+            state->file.write(pending.data(), pending.size());
+            state->file.flush();
+        }
+        if (stopping) {
+            state->written += pending.size();
+            return;
+        }
+        lock.lock();
+        state->written += pending.size();
+    }
+}
+
+void capture_init(const config_snapshot& config) {
+    if (!config.capture_file.has_value()) {
+        return;
+    }
+
+    state = std::make_unique<capture_state>();
+    state->file.open(config.capture_file.value(), std::ios::binary | std::ios::trunc);
+    if (!state->file) {
+        spdlog::error("Could not open capture file, not capturing: path='{}'", config.capture_file.value());
+        state.reset();
+        return;
+    }
+    state->max_bytes = static_cast<uint64_t>(config.capture_max_mb) * 1024 * 1024;
+    state->start = std::chrono::steady_clock::now();
+    std::random_device random;
+    state->salt = std::uniform_int_distribution<uint64_t>()(random);
+
+    // The salt is never written, so hashes can't be matched against known IDs
+    std::string header = TRACE_MAGIC;
+    put_varint(header, std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    state->buffer = header;
+
+    state->thread = std::thread(capture_thread_task);
+    enabled = true;
+    spdlog::info("Capturing workload trace: path='{}' max_mb={}", config.capture_file.value(), config.capture_max_mb);
+}
+
+void capture_shutdown() {
+    if (!state) {
+        return;
+    }
+
+    enabled = false;
+    {
+        std::lock_guard lock(state->mutex);
+        state->stopping = true;
+    }
+    state->cv.notify_all();
+    if (state->thread.joinable()) {
+        state->thread.join();
+    }
+    spdlog::info("Workload trace closed: bytes={}", state->written);
+    state.reset();
+}
+
+bool capture_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+uint32_t capture_anonymize(std::string_view value) {
+    if (value.empty() || !state) {
+        return 0;
+    }
+
+    auto hash = fnv1a_hash(value, state->salt);
+    auto folded = static_cast<uint32_t>(hash ^ hash >> 32);
+    return folded == 0 ? 1 : folded;
+}
+
+void capture_record(trace_kind kind, std::string_view op, std::chrono::steady_clock::time_point start,
+        uint16_t status, uint32_t user, uint32_t object, uint32_t size) {
+    static auto& records_total = metrics_counter("capture_records_total", "Records written to the workload trace");
+    static auto& dropped_total = metrics_counter("capture_dropped_total", "Records dropped from the workload trace");
+
+    if (!capture_enabled()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::unique_lock lock(state->mutex);
+    if (state->buffer.size() >= CAPTURE_BUFFER_BYTES) {
+        lock.unlock();
+        dropped_total.inc();
+        return;
+    }
+    if (state->written + state->buffer.size() >= state->max_bytes) {
+        lock.unlock();
+        if (enabled.exchange(false)) {
+            spdlog::warn("Workload trace reached capture_max_mb, capture stopped");
+        }
+        return;
+    }
+
+    auto [name, inserted] = state->names.try_emplace(std::string(op), static_cast<uint32_t>(state->names.size()));
+    if (inserted) {
+        state->buffer.push_back(TRACE_FRAME_NAME);
+        put_varint(state->buffer, name->second);
+        put_varint(state->buffer, op.size());
+        state->buffer.append(op);
+    }
+
+    auto offset = start > state->start ? start - state->start : std::chrono::steady_clock::duration::zero();
+    state->buffer.push_back(TRACE_FRAME_RECORD);
+    state->buffer.push_back(static_cast<char>(kind));
+    put_varint(state->buffer, name->second);
+    put_varint(state->buffer, status);
+    put_varint(state->buffer, user);
+    put_varint(state->buffer, object);
+    put_varint(state->buffer, std::chrono::duration_cast<std::chrono::microseconds>(offset).count());
+    put_varint(state->buffer, std::chrono::duration_cast<std::chrono::microseconds>(now - start).count());
+    put_varint(state->buffer, size);
+    lock.unlock();
+
+    records_total.inc();
+}
+
+TraceReader::TraceReader(const std::string& path) : file(path, std::ios::binary) {
+    std::string magic(std::strlen(TRACE_MAGIC), '\0');
+    if (!file.read(magic.data(), magic.size()) || magic != TRACE_MAGIC) {
+        return;
+    }
+    auto start_us = get_varint(file);
+    if (!start_us.has_value()) {
+        return;
+    }
+    start = std::chrono::system_clock::time_point(std::chrono::microseconds(start_us.value()));
+    header_valid = true;
+}
+
+std::optional<trace_record> TraceReader::next() {
+    if (!header_valid) {
+        return {};
+    }
+
+    while (true) {
+        int tag = file.get();
+        if (tag == TRACE_FRAME_NAME) {
+            auto id = get_varint(file);
+            auto length = get_varint(file);
+            if (!id.has_value() || !length.has_value() || id.value() != names.size()) {
+                return {};
+            }
+            std::string name(length.value(), '\0');
+            if (!file.read(name.data(), name.size())) {
+                return {};
+            }
+            names.push_back(std::move(name));
+        } else if (tag == TRACE_FRAME_RECORD) {
+            int kind = file.get();
+            std::optional<uint64_t> fields[7];
+            for (auto& field : fields) {
+                field = get_varint(file);
+                if (!field.has_value()) {
+                    return {};
+                }
+            }
+            if (kind == EOF || fields[0].value() >= names.size()) {
+                return {};
+            }
+
+            trace_record record;
+            record.kind = static_cast<trace_kind>(kind);
+            record.op = names[fields[0].value()];
+            record.status = static_cast<uint16_t>(fields[1].value());
+            record.user = static_cast<uint32_t>(fields[2].value());
+            record.object = static_cast<uint32_t>(fields[3].value());
+            record.offset = std::chrono::microseconds(fields[4].value());
+            record.duration = std::chrono::microseconds(fields[5].value());
+            record.size = static_cast<uint32_t>(fields[6].value());
+            return record;
+        } else {
+            // End of file, or a frame cut short by a crash
+            return {};
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <cmath>
+#include <format>
+
+#include "choretracker/concurrency_limit.h"
+
+ConcurrencyLimiter::ConcurrencyLimiter(const std::string& name)
+    : admitted(metrics_counter(std::format("concurrency_admitted_total{{limiter=\"{}\"}}", name), "Requests let through by the concurrency limiter")),
+    shed_high(metrics_counter(std::format("concurrency_shed_total{{limiter=\"{}\",priority=\"high\"}}", name), "Requests shed by the concurrency limiter")),
+    shed_low(metrics_counter(std::format("concurrency_shed_total{{limiter=\"{}\",priority=\"low\"}}", name), "Requests shed by the concurrency limiter")),
+    limit_gauge(metrics_gauge(std::format("concurrency_limit{{limiter=\"{}\"}}", name), "Current adaptive concurrency limit")),
+    in_flight_gauge(metrics_gauge(std::format("concurrency_in_flight{{limiter=\"{}\"}}", name), "Requests holding a concurrency slot")),
+    latency_gauge(metrics_gauge(std::format("concurrency_latency_milliseconds{{limiter=\"{}\"}}", name), "Recent average latency the limit is based on")) {
+    limit_gauge.set(CONCURRENCY_LIMIT_INITIAL);
+}
+
+bool ConcurrencyLimiter::try_acquire(request_priority priority, int min_limit, int max_limit) {
+    std::lock_guard lock(mutex);
+
+    // A reload may have moved the bounds since the last sample
+    limit = std::clamp(limit, static_cast<double>(min_limit), static_cast<double>(max_limit));
+    auto allowed = priority == request_priority::low
+        ? std::max(limit * CONCURRENCY_LIMIT_LOW_PRIORITY_SHARE, 1.0)
+        : limit;
+    if (in_flight >= static_cast<int>(allowed)) {
+        (priority == request_priority::low ? shed_low : shed_high).inc();
+        return false;
+    }
+
+    in_flight++;
+    in_flight_gauge.set(in_flight);
+    admitted.inc();
+    return true;
+}
+
+void ConcurrencyLimiter::release(std::optional<std::chrono::steady_clock::duration> latency, int min_limit, int max_limit) {
+    std::lock_guard lock(mutex);
+    if (latency.has_value()) {
+        update(std::chrono::duration<double, std::milli>(latency.value()).count(), min_limit, max_limit);
+    }
+    in_flight--;
+    in_flight_gauge.set(in_flight);
+}
+
+/// @brief Move the limit for a new latency sample, called with the lock held
+void ConcurrencyLimiter::update(double latency_ms, int min_limit, int max_limit) {
+    if (short_latency_ms == 0) {
+        short_latency_ms = latency_ms;
+        long_latency_ms = latency_ms;
+    }
+    short_latency_ms += (latency_ms - short_latency_ms) * CONCURRENCY_LIMIT_SHORT_WEIGHT;
+    auto long_weight = latency_ms > long_latency_ms ? CONCURRENCY_LIMIT_LONG_WEIGHT : CONCURRENCY_LIMIT_SHORT_WEIGHT;
+    long_latency_ms += (latency_ms - long_latency_ms) * long_weight;
+    latency_gauge.set(static_cast<int64_t>(short_latency_ms));
+
+    auto gradient = std::clamp(CONCURRENCY_LIMIT_TOLERANCE * long_latency_ms / std::max(short_latency_ms, 0.001), 0.5, 1.0);
+    if (gradient == 1.0 && in_flight < limit / 2) {
+        // Nowhere near the limit, so latency says nothing about whether more would fit
+        return;
+    }
+
+    // Headroom of sqrt(limit) lets it keep probing upwards while latency holds. Every
+    // request in flight reports in, so each only moves it a share of the way
+    auto target = limit * gradient + std::sqrt(limit);
+    limit += (target - limit) * CONCURRENCY_LIMIT_SMOOTHING / limit;
+    limit = std::clamp(limit, static_cast<double>(min_limit), static_cast<double>(max_limit));
+    limit_gauge.set(static_cast<int64_t>(limit));
+}
@@ -1,39 +1,34 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <fstream>
 #include <map>
 #include <optional>
 #include <string>
 #include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 #include <spdlog/cfg/helpers.h>
 #include <dpp/nlohmann/json.hpp>
 using json = nlohmann::json;
 
+#include "choretracker/config.h"
 #include "choretracker/utils.hpp"
 
-static json config_json;
-
-/// @brief Load config.json to be parsed
-/// @return Whether the file was successfully found
-bool config_load_file() {
-    std::ifstream config_file("config.json");
-    if (config_file.good()) {
-        config_json = json::parse(config_file);
-
-        // While we're here, also try loading spdlog levels if there aren't any loaded from env
-        if (config_json.contains("spdlog_level") && std::getenv("SPDLOG_LEVEL") == nullptr) {
-            spdlog::cfg::helpers::load_levels(config_json["spdlog_level"]);
-        }
+#define CONFIG_FILE "config.json"
 
-        return true;
-    } else {
-        return false;
-    }
-}
+static std::atomic<std::shared_ptr<const config_snapshot>> current_config;
 
 /// @brief Get a string property from either the config file or env
+/// @param config_json Parsed config file
 /// @param property Property name
 /// @return Property value as string if present
-std::optional<std::string> config_get_str(const std::string& property) {
+static std::optional<std::string> read_str(const json& config_json, const std::string& property) {
     char *env_value = std::getenv(("CHORETRACKER_" + uppercase(property)).c_str());
     if (env_value != nullptr) {
         return std::string(env_value);
@@ -45,9 +40,10 @@ std::optional<std::string> config_get_str(const std::string& property) {
 }
 
 /// @brief Get a boolean property from either the config file or env
+/// @param config_json Parsed config file
 /// @param property Property name
 /// @return Property value as boolean if present
-std::optional<bool> config_get_bool(const std::string& property) {
+static std::optional<bool> read_bool(const json& config_json, const std::string& property) {
     char *env_value = std::getenv(("CHORETRACKER_" + uppercase(property)).c_str());
     if (env_value != nullptr) {
         return std::strcmp(env_value, "1") == 0 || 
@@ -61,9 +57,10 @@ std::optional<bool> config_get_bool(const std::string& property) {
 }
 
 /// @brief Get a integer property from either the config file or env
+/// @param config_json Parsed config file
 /// @param property Property name
 /// @return Property value as integer if present
-std::optional<int> config_get_int(const std::string& property) {
+static std::optional<int> read_int(const json& config_json, const std::string& property) {
     char *env_value = std::getenv(("CHORETRACKER_" + uppercase(property)).c_str());
     if (env_value != nullptr) {
         return std::atoi(env_value);
@@ -72,4 +69,193 @@ std::optional<int> config_get_int(const std::string& property) {
     }
 
     return {};
-}
\ No newline at end of file
+}
+
+/// @brief Build a snapshot from env vars and the parsed config file
+/// @param config_json Parsed config file, or an empty object
+/// @return New snapshot
+static config_snapshot config_parse(const json& config_json) {
+    config_snapshot config;
+
+    config.bot_token = read_str(config_json, CONFIG_BOT_TOKEN);
+    config.test_guild = read_str(config_json, CONFIG_TEST_GUILD);
+    config.register_commands = read_bool(config_json, CONFIG_REGISTER_COMMANDS).value_or(false);
+    config.db_connection = read_str(config_json, CONFIG_DB_CONNECTION);
+    config.db_name = read_str(config_json, CONFIG_DB_NAME).value_or(DEFAULT_DB_NAME);
+    config.web_port = read_int(config_json, CONFIG_WEB_PORT).value_or(DEFAULT_WEB_PORT);
+    config.web_base_url = read_str(config_json, CONFIG_WEB_BASE_URL).value_or(DEFAULT_WEB_BASE_URL);
+    config.discord_client_id = read_str(config_json, CONFIG_DISCORD_CLIENT_ID);
+    config.discord_client_secret = read_str(config_json, CONFIG_DISCORD_CLIENT_SECRET);
+    config.alert_partitions = std::max(read_int(config_json, CONFIG_ALERT_PARTITIONS).value_or(DEFAULT_ALERT_PARTITIONS), 1);
+    config.alert_lease_seconds = std::max(read_int(config_json, CONFIG_ALERT_LEASE_SECONDS).value_or(DEFAULT_ALERT_LEASE_SECONDS), 3);
+    config.oauth_pool_size = std::max(read_int(config_json, CONFIG_OAUTH_POOL_SIZE).value_or(DEFAULT_OAUTH_POOL_SIZE), 1);
+    config.oauth_connect_timeout_ms = std::max(read_int(config_json, CONFIG_OAUTH_CONNECT_TIMEOUT_MS).value_or(DEFAULT_OAUTH_CONNECT_TIMEOUT_MS), 1);
+    config.oauth_read_timeout_ms = std::max(read_int(config_json, CONFIG_OAUTH_READ_TIMEOUT_MS).value_or(DEFAULT_OAUTH_READ_TIMEOUT_MS), 1);
+    config.db_read_preference = read_str(config_json, CONFIG_DB_READ_PREFERENCE).value_or(DEFAULT_DB_READ_PREFERENCE);
+    config.db_pool_min = read_int(config_json, CONFIG_DB_POOL_MIN);
+    config.db_pool_max = read_int(config_json, CONFIG_DB_POOL_MAX);
+    config.db_wait_queue_timeout_ms = read_int(config_json, CONFIG_DB_WAIT_QUEUE_TIMEOUT_MS);
+    config.db_write_concern = read_str(config_json, CONFIG_DB_WRITE_CONCERN);
+    config.db_coordination_write_concern = read_str(config_json, CONFIG_DB_COORDINATION_WRITE_CONCERN);
+    config.db_write_timeout_ms = read_int(config_json, CONFIG_DB_WRITE_TIMEOUT_MS);
+    config.gateway_intents = read_str(config_json, CONFIG_GATEWAY_INTENTS).value_or(DEFAULT_GATEWAY_INTENTS);
+    config.gateway_shard_count = std::max(read_int(config_json, CONFIG_GATEWAY_SHARD_COUNT).value_or(0), 0);
+    config.gateway_cluster_count = std::max(read_int(config_json, CONFIG_GATEWAY_CLUSTER_COUNT).value_or(1), 1);
+    config.gateway_cluster_id = std::clamp(read_int(config_json, CONFIG_GATEWAY_CLUSTER_ID).value_or(0), 0, config.gateway_cluster_count - 1);
+    config.interactions_public_key = read_str(config_json, CONFIG_INTERACTIONS_PUBLIC_KEY);
+    config.write_queue_dir = read_str(config_json, CONFIG_WRITE_QUEUE_DIR).value_or(DEFAULT_WRITE_QUEUE_DIR);
+    config.log_async = read_bool(config_json, CONFIG_LOG_ASYNC).value_or(true);
+    config.log_queue_size = std::max(read_int(config_json, CONFIG_LOG_QUEUE_SIZE).value_or(DEFAULT_LOG_QUEUE_SIZE), 1);
+    config.log_overflow_policy = read_str(config_json, CONFIG_LOG_OVERFLOW_POLICY).value_or(DEFAULT_LOG_OVERFLOW_POLICY);
+    config.capture_file = read_str(config_json, CONFIG_CAPTURE_FILE);
+    config.capture_max_mb = std::max(read_int(config_json, CONFIG_CAPTURE_MAX_MB).value_or(DEFAULT_CAPTURE_MAX_MB), 1);
+    config.replay_signing_key = read_str(config_json, CONFIG_REPLAY_SIGNING_KEY);
+    config.discord_rest_stubbed = read_bool(config_json, CONFIG_DISCORD_REST_STUBBED).value_or(false);
+
+    // Levels from the SPDLOG_LEVEL env var take priority over the config file
+    if (config_json.contains(CONFIG_SPDLOG_LEVEL) && std::getenv("SPDLOG_LEVEL") == nullptr) {
+        config.spdlog_level = config_json[CONFIG_SPDLOG_LEVEL];
+    }
+    config.alert_batch_size = std::max(read_int(config_json, CONFIG_ALERT_BATCH_SIZE).value_or(DEFAULT_ALERT_BATCH_SIZE), 1);
+    config.dm_rate_per_second = std::max(read_int(config_json, CONFIG_DM_RATE_PER_SECOND).value_or(DEFAULT_DM_RATE_PER_SECOND), 1);
+    config.dm_max_attempts = std::max(read_int(config_json, CONFIG_DM_MAX_ATTEMPTS).value_or(DEFAULT_DM_MAX_ATTEMPTS), 1);
+    config.shutdown_drain_seconds = std::max(read_int(config_json, CONFIG_SHUTDOWN_DRAIN_SECONDS).value_or(DEFAULT_SHUTDOWN_DRAIN_SECONDS), 0);
+    config.shutdown_grace_seconds = std::max(read_int(config_json, CONFIG_SHUTDOWN_GRACE_SECONDS).value_or(DEFAULT_SHUTDOWN_GRACE_SECONDS), 0);
+    config.web_rate_limit_per_second = std::max(read_int(config_json, CONFIG_WEB_RATE_LIMIT_PER_SECOND).value_or(DEFAULT_WEB_RATE_LIMIT_PER_SECOND), 1);
+    config.web_rate_limit_burst = std::max(read_int(config_json, CONFIG_WEB_RATE_LIMIT_BURST).value_or(DEFAULT_WEB_RATE_LIMIT_BURST), 1);
+    config.bot_rate_limit_per_second = std::max(read_int(config_json, CONFIG_BOT_RATE_LIMIT_PER_SECOND).value_or(DEFAULT_BOT_RATE_LIMIT_PER_SECOND), 1);
+    config.bot_rate_limit_burst = std::max(read_int(config_json, CONFIG_BOT_RATE_LIMIT_BURST).value_or(DEFAULT_BOT_RATE_LIMIT_BURST), 1);
+    config.web_concurrency_min = std::max(read_int(config_json, CONFIG_WEB_CONCURRENCY_MIN).value_or(DEFAULT_WEB_CONCURRENCY_MIN), 1);
+    config.web_concurrency_max = std::max(read_int(config_json, CONFIG_WEB_CONCURRENCY_MAX).value_or(DEFAULT_WEB_CONCURRENCY_MAX), config.web_concurrency_min);
+
+    return config;
+}
+
+/// @brief Apply the runtime-safe settings that are pushed rather than read on demand
+/// @param config Snapshot being published
+static void config_apply(const config_snapshot& config) {
+    if (config.spdlog_level.has_value()) {
+        spdlog::cfg::helpers::load_levels(config.spdlog_level.value());
+    }
+}
+
+/// @brief Load config.json (if present) and env vars into the current snapshot
+/// @return Whether the file was successfully found
+bool config_load_file() {
+    json config_json = json::object();
+
+    std::ifstream config_file(CONFIG_FILE);
+    bool found = config_file.good();
+    if (found) {
+        config_json = json::parse(config_file);
+    }
+
+    auto config = std::make_shared<const config_snapshot>(config_parse(config_json));
+    config_apply(*config);
+    current_config.store(config);
+
+    return found;
+}
+
+/// @brief Get the current configuration snapshot
+/// @return Snapshot, valid for as long as the caller holds it
+std::shared_ptr<const config_snapshot> config_get() {
+    return current_config.load();
+}
+
+/// @brief Re-read config.json, keeping startup-only settings from the current snapshot
+static void config_reload() {
+    config_snapshot config;
+    try {
+        std::ifstream config_file(CONFIG_FILE);
+        if (!config_file.good()) {
+            return;
+        }
+        config = config_parse(json::parse(config_file));
+    } catch (const std::exception& e) {
+        // Editors can leave a partial file mid-save, and a value of the wrong type would throw
+        // here on the watch thread, so keep the old config until it parses
+        spdlog::warn("Failed to parse config file, keeping current config: {}", e.what());
+        return;
+    }
+
+    auto current = config_get();
+
+    // Only runtime-safe settings are taken from the new file
+    auto reloaded = *current;
+    reloaded.spdlog_level = config.spdlog_level;
+    reloaded.alert_batch_size = config.alert_batch_size;
+    reloaded.dm_rate_per_second = config.dm_rate_per_second;
+    reloaded.dm_max_attempts = config.dm_max_attempts;
+    reloaded.shutdown_drain_seconds = config.shutdown_drain_seconds;
+    reloaded.shutdown_grace_seconds = config.shutdown_grace_seconds;
+    reloaded.web_rate_limit_per_second = config.web_rate_limit_per_second;
+    reloaded.web_rate_limit_burst = config.web_rate_limit_burst;
+    reloaded.bot_rate_limit_per_second = config.bot_rate_limit_per_second;
+    reloaded.bot_rate_limit_burst = config.bot_rate_limit_burst;
+    reloaded.web_concurrency_min = config.web_concurrency_min;
+    reloaded.web_concurrency_max = config.web_concurrency_max;
+
+    // Everything not copied over above needs a restart, so any remaining difference is a
+    // setting the file changed that won't take effect yet
+    if (reloaded != config) {
+        spdlog::warn("Config file changed settings that need a restart to take effect");
+    }
+
+    auto snapshot = std::make_shared<const config_snapshot>(std::move(reloaded));
+    try {
+        config_apply(*snapshot);
+    } catch (const std::exception& e) {
+        spdlog::warn("Failed to apply config file, keeping current config: {}", e.what());
+        return;
+    }
+    current_config.store(snapshot);
+    spdlog::info("Config file reloaded");
+}
+
+/// @brief Watch config.json for changes and reload it in the background
+void config_watch() {
+#ifdef __linux__
+    // Watch the directory rather than the file, as editors and config management
+    // usually replace the file rather than writing it in place
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        spdlog::warn("Unable to watch config file for changes: {}", std::strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    std::thread watch_thread([fd]() {
+        alignas(inotify_event) char buffer[4096];
+        while (true) {
+            auto length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                spdlog::warn("Stopped watching config file: {}", std::strerror(errno));
+                return;
+            }
+
+            bool changed = false;
+            for (char* ptr = buffer; ptr < buffer + length; ) {
+                auto event = reinterpret_cast<inotify_event*>(ptr);
+                if (event->len > 0 && std::strcmp(event->name, CONFIG_FILE) == 0) {
+                    changed = true;
+                }
+                ptr += sizeof(inotify_event) + event->len;
+            }
+
+            if (changed) {
+                config_reload();
+            }
+        }
+    });
+    watch_thread.detach();
+    spdlog::info("Watching config file for changes");
+#else
+    spdlog::info("Config file reloading is not supported on this platform");
+#endif
+}
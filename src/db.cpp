@@ -1,8 +1,22 @@
+#include <cstring>
 #include <format>
+#include <set>
+#include <unordered_set>
+#include <bsoncxx/builder/basic/array.hpp>
 #include <bsoncxx/builder/stream/document.hpp>
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/exception/bulk_write_exception.hpp>
+#include <mongocxx/exception/error_code.hpp>
+#include <mongocxx/exception/operation_exception.hpp>
+#include <mongocxx/exception/server_error_code.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <mongocxx/options/bulk_write.hpp>
+#include <mongocxx/pipeline.hpp>
 #include <spdlog/spdlog.h>
 
+#include "choretracker/capture.h"
 #include "choretracker/db.h"
+#include "choretracker/metrics.h"
 #include "choretracker/utils.hpp"
 
 using bsoncxx::builder::basic::kvp;
@@ -10,10 +24,304 @@ using bsoncxx::builder::basic::make_document;
 
 #define TASK_COL "chores"
 #define USER_SESSION_COL "user_sessions"
+#define ALERTER_NODE_COL "alerter_nodes"
+#define ALERTER_LEASE_COL "alerter_leases"
+#define USER_SETTINGS_COL "user_settings"
+#define TASK_COMPLETION_COL "task_completions"
+#define ALERT_RUN_REQUEST_COL "alert_run_requests"
+
+// The driver's maxPoolSize when the URI doesn't set one
+#define DEFAULT_POOL_MAX_SIZE 100
+
+// Documents fetched per round trip when walking every task
+#define TASK_CURSOR_BATCH_SIZE 500
+
+// Completion idempotency keys remembered per task. Replays after a crash repeat every write
+// since the last checkpoint, so this bounds how many completions of one task that can cover
+#define TASK_APPLIED_KEYS_KEPT 100
+
+// Times a completion is retried when the task is replaced between reading its rule and updating it
+#define TASK_COMPLETE_ATTEMPTS 3
+
+// Server error code for a unique index violation
+#define DUPLICATE_KEY_ERROR 11000
+
+// Fields that can be requested from a task listing
+static const std::set<std::string> TASK_FIELDS = {
+   "name", "type", "frequency_days", "last_completed", "next_due", "recurrence", "days_since_completed", "days_overdue"
+};
+
+/// @brief Aggregation expression for a task's next due date, as a "YYYY-MM-DD" string
+///
+/// Only right for tasks without a recurrence rule
+/// @param last_completed Completion date, either a date string or a field path like "$last_completed"
+/// @return Expression document
+static bsoncxx::document::value next_due_expression(const std::string& last_completed) {
+   return make_document(
+      kvp("$dateToString", make_document(
+         kvp("format", "%Y-%m-%d"),
+         kvp("date", make_document(
+            kvp("$dateAdd", make_document(
+               kvp("startDate", make_document(
+                  kvp("$dateFromString", make_document(kvp("dateString", last_completed)))
+               )),
+               kvp("unit", "day"),
+               kvp("amount", "$frequency_days")
+            ))
+         ))
+      ))
+   );
+}
+
+/// @brief Add a query string option to a connection string
+static std::string append_uri_option(const std::string& uri, const std::string& option, int value) {
+   auto scheme_end = uri.find("://");
+   auto hosts_start = scheme_end == std::string::npos ? 0 : scheme_end + 3;
+   if (uri.find('?') != std::string::npos) {
+      return std::format("{}&{}={}", uri, option, value);
+   } else if (uri.find('/', hosts_start) != std::string::npos) {
+      return std::format("{}?{}={}", uri, option, value);
+   } else {
+      return std::format("{}/?{}={}", uri, option, value);
+   }
+}
+
+static mongocxx::read_preference parse_read_preference(const std::string& mode) {
+   mongocxx::read_preference read_preference;
+   if (mode == "primaryPreferred") {
+      read_preference.mode(mongocxx::read_preference::read_mode::k_primary_preferred);
+   } else if (mode == "secondary") {
+      read_preference.mode(mongocxx::read_preference::read_mode::k_secondary);
+   } else if (mode == "secondaryPreferred") {
+      read_preference.mode(mongocxx::read_preference::read_mode::k_secondary_preferred);
+   } else if (mode == "nearest") {
+      read_preference.mode(mongocxx::read_preference::read_mode::k_nearest);
+   } else if (mode != "primary") {
+      spdlog::warn("Unknown DB read preference, using primary: read_preference='{}'", mode);
+   }
+   return read_preference;
+}
+
+static std::optional<mongocxx::write_concern> parse_write_concern(const std::optional<std::string>& level, const std::optional<int>& timeout_ms) {
+   if (!level.has_value()) {
+      return {};
+   }
+
+   mongocxx::write_concern write_concern;
+   if (level.value() == "majority") {
+      write_concern.acknowledge_level(mongocxx::write_concern::level::k_majority);
+   } else {
+      try {
+         write_concern.nodes(std::stoi(level.value()));
+      } catch (const std::exception&) {
+         spdlog::warn("Unknown DB write concern, using the default: write_concern='{}'", level.value());
+         return {};
+      }
+   }
+   if (timeout_ms.has_value()) {
+      write_concern.timeout(std::chrono::milliseconds(timeout_ms.value()));
+   }
+   return write_concern;
+}
+
+/// @brief Build the pool's connection string, with pool settings layered over the configured URI
+static std::string pool_uri(const std::string& connection_uri, const database_options& options) {
+   auto uri = connection_uri;
+   if (options.pool_max.has_value()) {
+      uri = append_uri_option(uri, "maxPoolSize", options.pool_max.value());
+   }
+   if (options.wait_queue_timeout_ms.has_value()) {
+      uri = append_uri_option(uri, "waitQueueTimeoutMS", options.wait_queue_timeout_ms.value());
+   }
+   return uri;
+}
+
+Database::Database(const std::string& connection_uri, const std::string& db_name, const database_options& options)
+      : pool(mongocxx::uri(pool_uri(connection_uri, options))), db_name(db_name),
+      read_preference(parse_read_preference(options.read_preference)),
+      write_concern(parse_write_concern(options.write_concern, options.write_timeout_ms)),
+      coordination_write_concern(parse_write_concern(options.coordination_write_concern, options.write_timeout_ms)) {
+   auto pool_max = options.pool_max.value_or(DEFAULT_POOL_MAX_SIZE);
+   metrics_gauge("db_pool_max_size", "Most clients the DB pool will open").set(pool_max);
+
+   // The driver has no minimum pool size, so open that many clients up front and
+   // hand them back, leaving them idle in the pool
+   if (options.pool_min.has_value()) {
+      std::vector<mongocxx::pool::entry> warm;
+      for (int i = 0; i < std::min(options.pool_min.value(), pool_max); i++) {
+         warm.push_back(pool.acquire());
+      }
+   }
+
+   init();
+}
+
+// Time this thread has held (or waited for) DB clients, for callers timing their own DB use
+static thread_local std::chrono::steady_clock::duration thread_db_time{};
+
+/// @brief Total time the calling thread has spent in Database calls, from waiting for a client to handing it back
+/// @return Running total, diff two readings to time a piece of work
+std::chrono::steady_clock::duration db_thread_time() {
+   return thread_db_time;
+}
+
+/// @brief Whether an error means Mongo couldn't be reached (down, failing over or timing out)
+/// rather than it refusing the operation, so the same operation can succeed if tried again
+bool db_is_unavailable(const std::exception& e) {
+   // libmongoc's own errors share the server error category, so this mixes client codes
+   // (name resolution, socket, connect, not established, server selection) with server codes
+   // for network failures, elections, shutdowns and time limits
+   static const std::unordered_set<int> UNAVAILABLE_CODES = {
+      3, 4, 5, 6, 7, 13053,
+      50, 64, 89, 91, 189, 262, 9001, 10107, 11600, 11602, 13435, 13436
+   };
+
+   auto mongo_error = dynamic_cast<const mongocxx::exception*>(&e);
+   if (mongo_error == nullptr) {
+      return false;
+   }
+   auto code = mongo_error->code();
+   if (code == mongocxx::error_code::k_pool_wait_queue_timeout) {
+      return true;
+   }
+   return code.category() == mongocxx::server_error_category() && UNAVAILABLE_CODES.contains(code.value());
+}
+
+static Metric& pool_in_use() {
+   static auto& in_use = metrics_gauge("db_pool_in_use", "DB clients currently checked out of the pool");
+   return in_use;
+}
+
+Database::pooled_client::pooled_client(const Database& database, mongocxx::pool::entry entry, const char* caller, std::chrono::steady_clock::time_point started)
+   : database(database), entry(std::move(entry)), caller(caller), started(started), exceptions_at_acquire(std::uncaught_exceptions()) {
+   pool_in_use().inc();
+}
+
+Database::pooled_client::~pooled_client() {
+   pool_in_use().dec();
+   thread_db_time += std::chrono::steady_clock::now() - started;
+
+   if (caller != nullptr && capture_enabled()) {
+      // "bool Database::add_task(const task_definition&)" -> "add_task"
+      std::string_view op(caller);
+      auto scope = op.find("Database::");
+      if (scope != std::string_view::npos) {
+         op.remove_prefix(scope + std::strlen("Database::"));
+      }
+      op = op.substr(0, op.find('('));
+      capture_record(trace_kind::db, op, started, std::uncaught_exceptions() > exceptions_at_acquire ? 1 : 0);
+   }
+}
+
+mongocxx::database Database::pooled_client::primary() {
+   auto db = (*entry)[database.db_name];
+   if (database.write_concern.has_value()) {
+      db.write_concern(database.write_concern.value());
+   }
+   return db;
+}
+
+mongocxx::database Database::pooled_client::reader() {
+   auto db = (*entry)[database.db_name];
+   db.read_preference(database.read_preference);
+   return db;
+}
+
+mongocxx::database Database::pooled_client::coordination() {
+   auto db = (*entry)[database.db_name];
+   if (database.coordination_write_concern.has_value()) {
+      db.write_concern(database.coordination_write_concern.value());
+   } else if (database.write_concern.has_value()) {
+      db.write_concern(database.write_concern.value());
+   }
+   return db;
+}
+
+/// @brief Check a client out of the pool, tracking how often callers have to queue for one
+/// @param location Calling method, named in the workload trace when capturing
+Database::pooled_client Database::acquire(std::source_location location) {
+   static auto& waits = metrics_counter("db_pool_waits_total", "DB client checkouts that had to wait for a free client");
+   static auto& wait_ms = metrics_counter("db_pool_wait_milliseconds_total", "Time spent waiting for a free DB client");
+   static auto& timeouts = metrics_counter("db_pool_wait_timeouts_total", "DB client checkouts that gave up waiting");
+
+   auto start = std::chrono::steady_clock::now();
+   auto caller = capture_enabled() ? location.function_name() : nullptr;
+   auto entry = pool.try_acquire();
+   if (entry.has_value()) {
+      return pooled_client(*this, std::move(entry.value()), caller, start);
+   }
+
+   // Pool is saturated, queue for the next free client
+   waits.inc();
+   try {
+      auto waited_entry = pool.acquire();
+      wait_ms.inc(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+      return pooled_client(*this, std::move(waited_entry), caller, start);
+   } catch (const std::exception&) {
+      timeouts.inc();
+      thread_db_time += std::chrono::steady_clock::now() - start;
+      throw;
+   }
+}
+
+void Database::init() {
+   auto client = acquire();
+   auto db = client.primary();
+
+   // Listings are paged in name or due date order
+   db[TASK_COL].create_index(make_document(kvp("owner_user_id", 1), kvp("name", 1), kvp("_id", 1)));
+   db[TASK_COL].create_index(make_document(kvp("owner_user_id", 1), kvp("next_due", 1), kvp("_id", 1)));
+   // Task names are unique per user, so adds and imports can't duplicate a task
+   try {
+      db[TASK_COL].create_index(
+         make_document(kvp("owner_user_id", 1), kvp("name", 1)),
+         make_document(kvp("unique", true))
+      );
+   } catch (const mongocxx::operation_exception& e) {
+      spdlog::warn("Unable to add unique task name index, some user may already have duplicate task names: error='{}'", e.what());
+   }
+   // Backfill the due date on tasks created before it was stored
+   mongocxx::pipeline backfill;
+   backfill.add_fields(make_document(kvp("next_due", next_due_expression("$last_completed"))));
+   db[TASK_COL].update_many(make_document(
+      kvp("next_due", make_document(kvp("$exists", false)))
+   ), backfill);
+
+   // Session lookups are always by cookie
+   db[USER_SESSION_COL].create_index(
+      make_document(kvp("session_cookie", 1)),
+      make_document(kvp("unique", true))
+   );
+   // Let Mongo remove sessions once they pass their expiry time
+   db[USER_SESSION_COL].create_index(
+      make_document(kvp("expires_at", 1)),
+      make_document(kvp("expireAfterSeconds", 0))
+   );
+   // One settings document per user, also relied on by claim_user_alert
+   db[USER_SETTINGS_COL].create_index(
+      make_document(kvp("user_id", 1)),
+      make_document(kvp("unique", true))
+   );
+   // Completion history is bucketed per task per month
+   db[TASK_COMPLETION_COL].create_index(
+      make_document(kvp("owner_user_id", 1), kvp("name", 1), kvp("month", 1)),
+      make_document(kvp("unique", true))
+   );
+   // Dead alerter nodes are cleaned up the same way
+   db[ALERTER_NODE_COL].create_index(
+      make_document(kvp("expires_at", 1)),
+      make_document(kvp("expireAfterSeconds", 0))
+   );
+   // As are alert run requests nobody could report back on any more
+   db[ALERT_RUN_REQUEST_COL].create_index(
+      make_document(kvp("expires_at", 1)),
+      make_document(kvp("expireAfterSeconds", 0))
+   );
+}
 
 std::vector<task_definition> Database::list_all_tasks() {
-   auto client = pool.acquire();
-   auto db = client[db_name];
+   auto client = acquire();
+   auto db = client.reader();
 
    auto cursor = db[TASK_COL].find({});
 
@@ -23,20 +331,40 @@ std::vector<task_definition> Database::list_all_tasks() {
       if (def.has_value()) {
          tasks.emplace_back(def.value());
       } else {
-         spdlog::warn(std::format("Invalid task document in db: id='{}'", doc["_id"].get_oid().value.to_string()));
+         spdlog::warn("Invalid task document in db: id='{}'", doc["_id"].get_oid().value.to_string());
       }
    }
 
    return tasks;
 }
 
+void Database::bump_write_generation(const dpp::snowflake& user_id) {
+   task_write_generations[static_cast<uint64_t>(user_id) % TASK_WRITE_GENERATION_STRIPES].fetch_add(1);
+}
+
+/// @brief Key for a user's shared reads, changing with each of their writes
+std::string Database::flight_key(const dpp::snowflake& user_id) const {
+   auto generation = task_write_generations[static_cast<uint64_t>(user_id) % TASK_WRITE_GENERATION_STRIPES].load();
+   return std::format("{}\x1f{}", user_id.str(), generation);
+}
+
+/// @brief List a user's tasks, sharing the query with any identical one already running
 std::vector<task_definition> Database::list_tasks_by_user(const dpp::snowflake& user_id) {
-   auto client = pool.acquire();
-   auto db = client[db_name];
+   return tasks_by_user_flight.run(flight_key(user_id), [this, &user_id]() {
+      return fetch_tasks_by_user(user_id);
+   });
+}
+
+std::vector<task_definition> Database::fetch_tasks_by_user(const dpp::snowflake& user_id) {
+   auto client = acquire();
+   auto db = client.reader();
+
+   mongocxx::options::find opts;
+   opts.sort(make_document(kvp("name", 1)));
 
    auto cursor = db[TASK_COL].find(make_document(
       kvp("owner_user_id", user_id.str())
-   ));
+   ), opts);
 
    std::vector<task_definition> tasks;
    for (auto&& doc : cursor) {
@@ -44,16 +372,23 @@ std::vector<task_definition> Database::list_tasks_by_user(const dpp::snowflake&
       if (def.has_value()) {
          tasks.emplace_back(def.value());
       } else {
-         spdlog::warn(std::format("Invalid task document in db: id='{}'", doc["_id"].get_oid().value.to_string()));
+         spdlog::warn("Invalid task document in db: id='{}'", doc["_id"].get_oid().value.to_string());
       }
    }
 
    return tasks;
 }
 
+/// @brief Search a user's tasks, sharing the query with any identical one already running
 std::vector<task_definition> Database::find_tasks_by_name(const dpp::snowflake& user_id, const std::string &query) {
-   auto client = pool.acquire();
-   auto db = client[db_name];
+   return tasks_by_name_flight.run(flight_key(user_id) + '\x1f' + query, [this, &user_id, &query]() {
+      return fetch_tasks_by_name(user_id, query);
+   });
+}
+
+std::vector<task_definition> Database::fetch_tasks_by_name(const dpp::snowflake& user_id, const std::string &query) {
+   auto client = acquire();
+   auto db = client.reader();
 
    auto cursor = db[TASK_COL].find(make_document(
       kvp("owner_user_id", user_id.str()),
@@ -68,16 +403,139 @@ std::vector<task_definition> Database::find_tasks_by_name(const dpp::snowflake&
       if (def.has_value()) {
          tasks.emplace_back(def.value());
       } else {
-         spdlog::warn(std::format("Invalid task document in db: id='{}'", doc["_id"].get_oid().value.to_string()));
+         spdlog::warn("Invalid task document in db: id='{}'", doc["_id"].get_oid().value.to_string());
       }
    }
    
    return tasks;
 }
 
+/// @brief Page through a user's tasks, sharing the query with any identical one already running
+std::optional<task_page> Database::list_tasks_page(const dpp::snowflake& user_id, const task_query& query) {
+   auto key = std::format("{}\x1f{}\x1f{}", flight_key(user_id), static_cast<int>(query.sort), query.limit);
+   if (query.after.has_value()) {
+      key += std::format("\x1f{}\x1f{}", query.after->first, query.after->second);
+   }
+   key += '\x1f';
+   for (const auto& field : query.fields) {
+      key += field + ',';
+   }
+
+   return tasks_page_flight.run(key, [this, &user_id, &query]() {
+      return fetch_tasks_page(user_id, query);
+   });
+}
+
+std::optional<task_page> Database::fetch_tasks_page(const dpp::snowflake& user_id, const task_query& query) {
+   for (const auto& field : query.fields) {
+      if (!TASK_FIELDS.contains(field)) {
+         return {};
+      }
+   }
+
+   auto client = acquire();
+   auto db = client.reader();
+
+   const std::string sort_field = query.sort == task_sort::due ? "next_due" : "name";
+
+   // Continue after the last task of the previous page, using _id to break ties
+   bsoncxx::builder::basic::document filter;
+   filter.append(kvp("owner_user_id", user_id.str()));
+   if (query.after.has_value()) {
+      bsoncxx::oid after_id;
+      try {
+         after_id = bsoncxx::oid(query.after->second);
+      } catch (const std::exception&) {
+         return {};
+      }
+      filter.append(kvp("$or", bsoncxx::builder::basic::make_array(
+         make_document(kvp(sort_field, make_document(kvp("$gt", query.after->first)))),
+         make_document(
+            kvp(sort_field, query.after->first),
+            kvp("_id", make_document(kvp("$gt", after_id)))
+         )
+      )));
+   }
+
+   mongocxx::options::find opts;
+   opts.sort(make_document(kvp(sort_field, 1), kvp("_id", 1)));
+   if (query.limit > 0) {
+      // One extra to tell whether there's another page
+      opts.limit(static_cast<int64_t>(query.limit + 1));
+   }
+   if (!query.fields.empty()) {
+      bsoncxx::builder::basic::document projection;
+      std::set<std::string> projected = { sort_field };
+      for (const auto& field : query.fields) {
+         if (field == "days_since_completed" || field == "days_overdue") {
+            projected.insert("last_completed");
+            projected.insert("next_due");
+         } else {
+            projected.insert(field);
+         }
+      }
+      for (const auto& field : projected) {
+         projection.append(kvp(field, 1));
+      }
+      opts.projection(projection.extract());
+   }
+
+   auto cursor = db[TASK_COL].find(filter.extract(), opts);
+
+   task_page page;
+   auto today = std::chrono::sys_days(get_today_as_ymd());
+   std::optional<std::pair<std::string, std::string>> last_position;
+   for (auto&& doc : cursor) {
+      if (query.limit > 0 && page.tasks.size() == query.limit) {
+         page.next = last_position;
+         break;
+      }
+
+      try {
+         nlohmann::json task;
+         if (doc["name"]) task["name"] = bson_to_string(doc["name"]);
+         if (doc["type"]) task["type"] = doc["type"].get_int32().value;
+         if (doc["frequency_days"]) task["frequency_days"] = doc["frequency_days"].get_int32().value;
+         if (doc["last_completed"]) task["last_completed"] = bson_to_string(doc["last_completed"]);
+         if (doc["next_due"]) task["next_due"] = bson_to_string(doc["next_due"]);
+         if (doc["recurrence"]) task["recurrence"] = bson_to_string(doc["recurrence"]);
+         if (doc["last_completed"]) {
+            auto last_completed = parse_ymd(bson_to_string(doc["last_completed"])).value();
+            task["days_since_completed"] = (today - std::chrono::sys_days(last_completed)).count();
+         }
+         if (doc["next_due"]) {
+            // Stored next_due already accounts for recurrence rules
+            auto next_due = parse_ymd(bson_to_string(doc["next_due"])).value();
+            task["days_overdue"] = (today - std::chrono::sys_days(next_due)).count();
+         }
+
+         // Only hand back what was asked for
+         if (!query.fields.empty()) {
+            nlohmann::json projected_task = nlohmann::json::object();
+            for (const auto& field : query.fields) {
+               if (task.contains(field)) {
+                  projected_task[field] = task[field];
+               }
+            }
+            task = std::move(projected_task);
+         } else {
+            task["owner_user_id"] = user_id.str();
+         }
+
+         last_position = std::make_pair(bson_to_string(doc[sort_field]), doc["_id"].get_oid().value.to_string());
+         page.tasks.push_back(std::move(task));
+      } catch (const std::exception&) {
+         spdlog::warn("Invalid task document in db: id='{}'", doc["_id"].get_oid().value.to_string());
+      }
+   }
+
+   return page;
+}
+
 bool Database::add_task(const task_definition& task) {
-   auto client = pool.acquire();
-   auto db = client[db_name];
+   write_generation_bump bump(*this, task.owner_user_id);
+   auto client = acquire();
+   auto db = client.primary();
 
    auto doc = task.to_bson();
    auto result = db[TASK_COL].insert_one(std::move(doc));
@@ -85,37 +543,319 @@ bool Database::add_task(const task_definition& task) {
    return result.has_value() && result.value().inserted_id().type() == bsoncxx::type::k_oid ;
 }
 
+/// @brief Insert many tasks at once, carrying on past any that fail
+///
+/// Tasks are upserted on owner and name, so one whose owner already has a task of that
+/// name is left alone rather than duplicated, e.g. when a backup is imported twice
+/// @return Number of tasks inserted
+size_t Database::insert_tasks(const std::vector<task_definition>& tasks) {
+   if (tasks.empty()) {
+      return 0;
+   }
+
+   write_generation_bump bump(*this);
+   for (const auto& task : tasks) {
+      bump.add(task.owner_user_id);
+   }
+   auto client = acquire();
+   auto db = client.primary();
+
+   mongocxx::options::bulk_write opts;
+   opts.ordered(false);
+   auto bulk = db[TASK_COL].create_bulk_write(opts);
+   for (const auto& task : tasks) {
+      mongocxx::model::update_one upsert(make_document(
+         kvp("owner_user_id", task.owner_user_id.str()),
+         kvp("name", task.name)
+      ), make_document(
+         kvp("$setOnInsert", task.to_bson())
+      ));
+      upsert.upsert(true);
+      bulk.append(upsert);
+   }
+
+   try {
+      auto result = bulk.execute();
+      return result.has_value() ? result.value().upserted_count() : 0;
+   } catch (const mongocxx::bulk_write_exception& e) {
+      // Unordered writes keep going past bad documents, so count what made it
+      auto raw = e.raw_server_error();
+      if (raw.has_value() && raw.value().view()["nUpserted"]) {
+         return raw.value().view()["nUpserted"].get_int32().value;
+      }
+      spdlog::error("Failed to insert tasks: count={} error='{}'", tasks.size(), e.what());
+      return 0;
+   }
+}
+
+/// @brief Visit tasks a cursor batch at a time, without holding them all in memory
+/// @param user_id Only visit this user's tasks, or every task if empty
+void Database::for_each_task(const std::optional<dpp::snowflake>& user_id, const std::function<void(const task_definition&)>& callback) {
+   auto client = acquire();
+   auto db = client.reader();
+
+   mongocxx::options::find opts;
+   opts.batch_size(TASK_CURSOR_BATCH_SIZE);
+   opts.sort(make_document(kvp("_id", 1)));
+
+   bsoncxx::builder::basic::document filter;
+   if (user_id.has_value()) {
+      filter.append(kvp("owner_user_id", user_id.value().str()));
+   }
+
+   auto cursor = db[TASK_COL].find(filter.extract(), opts);
+   for (auto&& doc : cursor) {
+      auto def = task_definition::from_bson(doc);
+      if (def.has_value()) {
+         callback(def.value());
+      } else {
+         spdlog::warn("Invalid task document in db: id='{}'", doc["_id"].get_oid().value.to_string());
+      }
+   }
+}
+
 bool Database::delete_task(const dpp::snowflake& user_id, const std::string& task_name) {
-   auto client = pool.acquire();
-   auto db = client[db_name];
+   write_generation_bump bump(*this, user_id);
+   auto client = acquire();
+   auto db = client.primary();
 
    auto result = db[TASK_COL].delete_one(make_document(
       kvp("owner_user_id", user_id.str()),
       kvp("name", task_name)
    ));
 
-   return result.has_value() && result.value().deleted_count() > 0;
+   bool deleted = result.has_value() && result.value().deleted_count() > 0;
+   if (deleted) {
+      db[TASK_COMPLETION_COL].delete_many(make_document(
+         kvp("owner_user_id", user_id.str()),
+         kvp("name", task_name)
+      ));
+   }
+
+   return deleted;
+}
+
+/// @brief Add a completion to the month's history for a task
+/// @param interval_days Days since the completion before it, if known
+/// @param idempotency_key If set, a completion already recorded with this key is not recorded again
+static void record_completion(mongocxx::database& db, const dpp::snowflake& user_id, const std::string& task_name,
+      const std::chrono::year_month_day& completed_on, const std::optional<int64_t>& interval_days, const std::string& idempotency_key) {
+   auto completed_str = ymd_to_string(completed_on);
+
+   bsoncxx::builder::basic::document filter;
+   filter.append(kvp("owner_user_id", user_id.str()));
+   filter.append(kvp("name", task_name));
+   filter.append(kvp("month", std::format("{:%Y}-{:%m}", completed_on.year(), completed_on.month())));
+
+   bsoncxx::builder::basic::document push;
+   push.append(kvp("completions", completed_str));
+   if (!idempotency_key.empty()) {
+      filter.append(kvp("applied_mutation_keys", make_document(kvp("$ne", idempotency_key))));
+      push.append(kvp("applied_mutation_keys", make_document(
+         kvp("$each", bsoncxx::builder::basic::make_array(idempotency_key)),
+         kvp("$slice", -TASK_APPLIED_KEYS_KEPT)
+      )));
+   }
+
+   try {
+      db[TASK_COMPLETION_COL].update_one(filter.extract(), make_document(
+         kvp("$inc", make_document(
+            kvp("count", 1),
+            kvp("interval_sum_days", interval_days.value_or(0)),
+            kvp("interval_count", interval_days.has_value() ? 1 : 0)
+         )),
+         kvp("$push", push.extract()),
+         kvp("$min", make_document(
+            kvp("first_completed", completed_str)
+         )),
+         kvp("$max", make_document(
+            kvp("last_completed", completed_str)
+         ))
+      ), mongocxx::options::update().upsert(true));
+   } catch (const mongocxx::operation_exception& e) {
+      // The month's bucket exists but already has the key, so the upsert tried to insert a second one
+      if (idempotency_key.empty() || e.code().category() != mongocxx::server_error_category()
+            || e.code().value() != DUPLICATE_KEY_ERROR) {
+         throw;
+      }
+   }
+}
+
+/// @brief Mark a task completed, recording it in the month's completion history
+/// @param completed_on Day it was completed, today if empty
+/// @param idempotency_key If set, a completion already applied with this key is not applied again
+/// @return Whether the task exists
+bool Database::complete_task(const dpp::snowflake& user_id, const std::string& task_name,
+      const std::optional<std::chrono::year_month_day>& completed_on, const std::string& idempotency_key) {
+   write_generation_bump bump(*this, user_id);
+   auto client = acquire();
+   auto db = client.primary();
+
+   auto today = completed_on.value_or(get_today_as_ymd());
+   auto today_str = ymd_to_string(today);
+
+   // Scheduled tasks need their rule to work out next_due, so it's read first and the
+   // update only goes through if the rule is still the same
+   mongocxx::options::find rule_opts;
+   rule_opts.projection(make_document(kvp("recurrence", 1)));
+
+   std::optional<bsoncxx::document::value> previous;
+   for (int attempt = 1; !previous.has_value(); attempt++) {
+      auto current = db[TASK_COL].find_one(make_document(
+         kvp("owner_user_id", user_id.str()),
+         kvp("name", task_name)
+      ), rule_opts);
+      if (!current.has_value()) {
+         return false;
+      }
+      auto recurrence_element = current->view()["recurrence"];
+      std::optional<std::string> rule_text;
+      if (recurrence_element) {
+         rule_text = bson_to_string(recurrence_element);
+      }
+      auto rule = rule_text.has_value() ? Recurrence::compile(rule_text.value()) : nullptr;
+
+      // Fetch the previous completion date while updating, to work out the interval
+      mongocxx::pipeline update;
+      bsoncxx::builder::basic::document fields;
+      fields.append(kvp("last_completed", today_str));
+      if (rule) {
+         auto next_due = std::chrono::year_month_day{ rule->next_due_after(std::chrono::sys_days(today)) };
+         fields.append(kvp("next_due", ymd_to_string(next_due)));
+      } else {
+         fields.append(kvp("next_due", next_due_expression(today_str)));
+      }
+      bsoncxx::builder::basic::document filter;
+      filter.append(kvp("owner_user_id", user_id.str()));
+      filter.append(kvp("name", task_name));
+      if (rule_text.has_value()) {
+         filter.append(kvp("recurrence", rule_text.value()));
+      } else {
+         filter.append(kvp("recurrence", make_document(kvp("$exists", false))));
+      }
+      if (!idempotency_key.empty()) {
+         // Every recent key is kept, as replaying an older completion after a newer one would roll the task back
+         fields.append(kvp("applied_mutation_keys", make_document(kvp("$slice", bsoncxx::builder::basic::make_array(
+            make_document(kvp("$concatArrays", bsoncxx::builder::basic::make_array(
+               make_document(kvp("$ifNull", bsoncxx::builder::basic::make_array("$applied_mutation_keys", bsoncxx::builder::basic::make_array()))),
+               bsoncxx::builder::basic::make_array(idempotency_key)
+            ))),
+            -TASK_APPLIED_KEYS_KEPT
+         )))));
+         filter.append(kvp("applied_mutation_keys", make_document(kvp("$ne", idempotency_key))));
+         // Single key kept by earlier versions
+         filter.append(kvp("last_mutation_key", make_document(kvp("$ne", idempotency_key))));
+      }
+      update.add_fields(fields.extract());
+
+      previous = db[TASK_COL].find_one_and_update(filter.extract(), update);
+      if (previous.has_value()) {
+         break;
+      }
+
+      // Already applied by an earlier replay, or the task was replaced since its rule was read
+      if (!idempotency_key.empty() && db[TASK_COL].count_documents(make_document(
+            kvp("owner_user_id", user_id.str()),
+            kvp("name", task_name),
+            kvp("$or", bsoncxx::builder::basic::make_array(
+               make_document(kvp("applied_mutation_keys", idempotency_key)),
+               make_document(kvp("last_mutation_key", idempotency_key))
+            ))
+         )) > 0) {
+         // The history may not have been written before a crash, the key stops it counting twice
+         record_completion(db, user_id, task_name, today, std::nullopt, idempotency_key);
+         return true;
+      }
+      if (attempt >= TASK_COMPLETE_ATTEMPTS) {
+         spdlog::warn("Task kept changing while being completed: user_id='{}' name='{}'", user_id.str(), task_name);
+         return false;
+      }
+   }
+
+   auto previous_task = task_definition::from_bson(previous.value());
+   int64_t interval_days = 0;
+   if (previous_task.has_value()) {
+      interval_days = (std::chrono::sys_days(today) - std::chrono::sys_days(previous_task->last_completed)).count();
+   }
+
+   record_completion(db, user_id, task_name, today,
+         previous_task.has_value() ? std::optional<int64_t>(interval_days) : std::nullopt, idempotency_key);
+
+   return true;
+}
+
+/// @brief Apply a queued task write, safe to repeat if it already made it to Mongo
+/// @return Whether the write took effect (the task was added, or existed to complete or delete)
+bool Database::apply_mutation(const task_mutation& mutation) {
+   switch (mutation.type) {
+      case task_mutation_type::add: {
+         // Upserting on owner and name means a replayed add never duplicates the task
+         auto client = acquire();
+         auto db = client.primary();
+         auto result = db[TASK_COL].update_one(make_document(
+            kvp("owner_user_id", mutation.task.owner_user_id.str()),
+            kvp("name", mutation.task.name)
+         ), make_document(
+            kvp("$setOnInsert", mutation.task.to_bson())
+         ), mongocxx::options::update().upsert(true));
+         return result.has_value() && result.value().upserted_id().has_value();
+      }
+      case task_mutation_type::complete: {
+         // Once-off tasks are done with once completed
+         std::optional<task_definition> task;
+         {
+            auto client = acquire();
+            auto db = client.primary();
+            auto existing = db[TASK_COL].find_one(make_document(
+               kvp("owner_user_id", mutation.task.owner_user_id.str()),
+               kvp("name", mutation.task.name)
+            ));
+            if (!existing.has_value()) {
+               return false;
+            }
+            task = task_definition::from_bson(existing.value());
+         }
+         if (task.has_value() && task->type == task_type::once_off) {
+            return delete_task(mutation.task.owner_user_id, mutation.task.name);
+         }
+         return complete_task(mutation.task.owner_user_id, mutation.task.name, mutation.completed_on, mutation.idempotency_key);
+      }
+      case task_mutation_type::remove:
+         return delete_task(mutation.task.owner_user_id, mutation.task.name);
+   }
+   return false;
 }
 
-bool Database::complete_task(const dpp::snowflake& user_id, const std::string& task_name) {
-   auto client = pool.acquire();
-   auto db = client[db_name];
+std::vector<completion_bucket> Database::list_completion_buckets(const dpp::snowflake& user_id, const std::string& task_name) {
+   auto client = acquire();
+   auto db = client.reader();
+
+   mongocxx::options::find opts;
+   opts.sort(make_document(kvp("month", 1)));
+   // The raw completion dates aren't needed for stats
+   opts.projection(make_document(kvp("completions", 0)));
 
-   auto result = db[TASK_COL].update_one(make_document(
+   auto cursor = db[TASK_COMPLETION_COL].find(make_document(
       kvp("owner_user_id", user_id.str()),
       kvp("name", task_name)
-   ), make_document(
-      kvp("$set", make_document(
-         kvp("last_completed", ymd_to_string(get_today_as_ymd()))
-      ))
-   ));
+   ), opts);
 
-   return result.has_value() && result.value().modified_count() > 0;
+   std::vector<completion_bucket> buckets;
+   for (auto&& doc : cursor) {
+      auto bucket = completion_bucket::from_bson(doc);
+      if (bucket.has_value()) {
+         buckets.emplace_back(bucket.value());
+      } else {
+         spdlog::warn("Invalid completion bucket in db: id='{}'", doc["_id"].get_oid().value.to_string());
+      }
+   }
+
+   return buckets;
 }
 
 std::optional<user_session> Database::get_session_by_cookie(const std::string& session_cookie) {
-   auto client = pool.acquire();
-   auto db = client[db_name];
+   auto client = acquire();
+   auto db = client.primary();
 
    auto doc = db[USER_SESSION_COL].find_one(make_document(
       kvp("session_cookie", session_cookie)
@@ -129,11 +869,314 @@ std::optional<user_session> Database::get_session_by_cookie(const std::string& s
 }
 
 bool Database::add_session(const user_session& session) {
-   auto client = pool.acquire();
-   auto db = client[db_name];
+   auto client = acquire();
+   auto db = client.primary();
 
    auto doc = session.to_bson();
    auto result = db[USER_SESSION_COL].insert_one(std::move(doc));
 
    return result.has_value() && result.value().inserted_id().type() == bsoncxx::type::k_oid;
-}
\ No newline at end of file
+}
+
+bool Database::renew_session(const std::string& session_cookie, std::chrono::system_clock::time_point expires_at) {
+   auto client = acquire();
+   auto db = client.primary();
+
+   auto result = db[USER_SESSION_COL].update_one(make_document(
+      kvp("session_cookie", session_cookie)
+   ), make_document(
+      kvp("$set", make_document(
+         kvp("expires_at", bsoncxx::types::b_date{expires_at})
+      ))
+   ));
+
+   return result.has_value() && result.value().modified_count() > 0;
+}
+
+bool Database::delete_session(const std::string& session_cookie) {
+   auto client = acquire();
+   auto db = client.primary();
+
+   auto result = db[USER_SESSION_COL].delete_one(make_document(
+      kvp("session_cookie", session_cookie)
+   ));
+
+   return result.has_value() && result.value().deleted_count() > 0;
+}
+
+bool Database::heartbeat_node(const std::string& node_id, std::chrono::system_clock::time_point expires_at) {
+   auto client = acquire();
+   auto db = client.coordination();
+
+   auto result = db[ALERTER_NODE_COL].update_one(make_document(
+      kvp("_id", node_id)
+   ), make_document(
+      kvp("$set", make_document(
+         kvp("expires_at", bsoncxx::types::b_date{expires_at})
+      ))
+   ), mongocxx::options::update().upsert(true));
+
+   return result.has_value();
+}
+
+bool Database::remove_node(const std::string& node_id) {
+   auto client = acquire();
+   auto db = client.coordination();
+
+   auto result = db[ALERTER_NODE_COL].delete_one(make_document(
+      kvp("_id", node_id)
+   ));
+
+   return result.has_value() && result.value().deleted_count() > 0;
+}
+
+std::vector<std::string> Database::list_live_nodes() {
+   auto client = acquire();
+   auto db = client.coordination();
+
+   auto cursor = db[ALERTER_NODE_COL].find(make_document(
+      kvp("expires_at", make_document(
+         kvp("$gt", bsoncxx::types::b_date{std::chrono::system_clock::now()})
+      ))
+   ));
+
+   std::vector<std::string> nodes;
+   for (auto&& doc : cursor) {
+      nodes.emplace_back(bson_to_string(doc["_id"]));
+   }
+
+   return nodes;
+}
+
+bool Database::acquire_partition_lease(int partition, const std::string& node_id, std::chrono::system_clock::time_point expires_at) {
+   auto client = acquire();
+   auto db = client.coordination();
+
+   // Take the lease if we already hold it or it has lapsed. If someone else holds
+   // a live lease the filter won't match, and the upsert fails on the duplicate _id.
+   try {
+      auto result = db[ALERTER_LEASE_COL].update_one(make_document(
+         kvp("_id", partition),
+         kvp("$or", bsoncxx::builder::basic::make_array(
+            make_document(kvp("owner", node_id)),
+            make_document(kvp("expires_at", make_document(
+               kvp("$lt", bsoncxx::types::b_date{std::chrono::system_clock::now()})
+            )))
+         ))
+      ), make_document(
+         kvp("$set", make_document(
+            kvp("owner", node_id),
+            kvp("expires_at", bsoncxx::types::b_date{expires_at})
+         ))
+      ), mongocxx::options::update().upsert(true));
+
+      return result.has_value() && (result.value().matched_count() > 0 || result.value().upserted_id().has_value());
+   } catch (const mongocxx::operation_exception&) {
+      return false;
+   }
+}
+
+bool Database::release_partition_lease(int partition, const std::string& node_id) {
+   auto client = acquire();
+   auto db = client.coordination();
+
+   // Expire the lease immediately so the new owner doesn't have to wait it out
+   auto result = db[ALERTER_LEASE_COL].update_one(make_document(
+      kvp("_id", partition),
+      kvp("owner", node_id)
+   ), make_document(
+      kvp("$set", make_document(
+         kvp("expires_at", bsoncxx::types::b_date{std::chrono::system_clock::time_point{}})
+      ))
+   ));
+
+   return result.has_value() && result.value().modified_count() > 0;
+}
+
+std::vector<std::string> Database::list_task_owners() {
+   auto client = acquire();
+   auto db = client.reader();
+
+   auto cursor = db[TASK_COL].distinct("owner_user_id", {});
+
+   std::vector<std::string> owners;
+   for (auto&& doc : cursor) {
+      for (auto&& value : doc["values"].get_array().value) {
+         owners.emplace_back(bsoncxx::string::to_string(value.get_string().value));
+      }
+   }
+
+   return owners;
+}
+
+std::vector<user_settings> Database::list_user_settings() {
+   auto client = acquire();
+   // Read from the primary, as the alert schedule goes by last_alerted and a lagging
+   // secondary would have it catch up users whose claim for today it hasn't seen yet
+   auto db = client.primary();
+
+   auto cursor = db[USER_SETTINGS_COL].find({});
+
+   std::vector<user_settings> settings;
+   for (auto&& doc : cursor) {
+      auto entry = user_settings::from_bson(doc);
+      if (entry.has_value()) {
+         settings.emplace_back(entry.value());
+      } else {
+         spdlog::warn("Invalid user settings document in db: id='{}'", doc["_id"].get_oid().value.to_string());
+      }
+   }
+
+   return settings;
+}
+
+std::optional<user_settings> Database::get_user_settings(const std::string& user_id) {
+   auto client = acquire();
+   auto db = client.primary();
+
+   auto doc = db[USER_SETTINGS_COL].find_one(make_document(
+      kvp("user_id", user_id)
+   ));
+
+   if (doc.has_value()) {
+      return user_settings::from_bson(doc.value());
+   } else {
+      return {};
+   }
+}
+
+bool Database::set_user_settings(const user_settings& settings) {
+   auto client = acquire();
+   auto db = client.primary();
+
+   auto result = db[USER_SETTINGS_COL].update_one(make_document(
+      kvp("user_id", settings.user_id)
+   ), make_document(
+      kvp("$set", make_document(
+         kvp("alert_minutes", settings.alert_minutes),
+         kvp("time_zone", settings.time_zone)
+      ))
+   ), mongocxx::options::update().upsert(true));
+
+   return result.has_value();
+}
+
+bool Database::claim_user_alert(const std::string& user_id, const std::chrono::year_month_day& local_date) {
+   auto client = acquire();
+   auto db = client.coordination();
+
+   // Only one caller can move last_alerted to a given date. If the user was already
+   // alerted that day the filter misses, and the upsert fails on the unique user_id.
+   try {
+      auto result = db[USER_SETTINGS_COL].update_one(make_document(
+         kvp("user_id", user_id),
+         kvp("last_alerted", make_document(
+            kvp("$ne", ymd_to_string(local_date))
+         ))
+      ), make_document(
+         kvp("$set", make_document(
+            kvp("last_alerted", ymd_to_string(local_date))
+         ))
+      ), mongocxx::options::update().upsert(true));
+
+      return result.has_value() && (result.value().modified_count() > 0 || result.value().upserted_id().has_value());
+   } catch (const mongocxx::operation_exception&) {
+      return false;
+   }
+}
+
+bool Database::release_user_alert(const std::string& user_id, const std::chrono::year_month_day& local_date) {
+   auto client = acquire();
+   auto db = client.coordination();
+
+   auto result = db[USER_SETTINGS_COL].update_one(make_document(
+      kvp("user_id", user_id),
+      kvp("last_alerted", ymd_to_string(local_date))
+   ), make_document(
+      kvp("$unset", make_document(
+         kvp("last_alerted", "")
+      ))
+   ));
+
+   return result.has_value() && result.value().modified_count() > 0;
+}
+
+bool Database::set_dm_channel(const std::string& user_id, const std::string& channel_id) {
+   auto client = acquire();
+   auto db = client.primary();
+
+   auto result = db[USER_SETTINGS_COL].update_one(make_document(
+      kvp("user_id", user_id)
+   ), make_document(
+      kvp("$set", make_document(
+         kvp("dm_channel_id", channel_id)
+      ))
+   ), mongocxx::options::update().upsert(true));
+
+   return result.has_value();
+}
+
+bool Database::record_alert_delivery(const std::string& user_id, bool delivered, const std::string& error) {
+   auto client = acquire();
+   auto db = client.primary();
+
+   auto result = db[USER_SETTINGS_COL].update_one(make_document(
+      kvp("user_id", user_id)
+   ), make_document(
+      kvp("$set", make_document(
+         kvp("last_delivery", make_document(
+            kvp("at", bsoncxx::types::b_date{std::chrono::system_clock::now()}),
+            kvp("delivered", delivered),
+            kvp("error", error)
+         ))
+      )),
+      kvp("$inc", make_document(
+         kvp(delivered ? "delivered_count" : "failed_count", 1)
+      ))
+   ), mongocxx::options::update().upsert(true));
+
+   return result.has_value();
+}
+
+/// @brief Leave a request to run alerts for whichever alerting process polls next
+bool Database::request_alert_run(const alert_run_request& request) {
+   auto client = acquire();
+   auto db = client.primary();
+
+   auto now = std::chrono::system_clock::now();
+   auto result = db[ALERT_RUN_REQUEST_COL].insert_one(make_document(
+      kvp("interaction_token", request.interaction_token),
+      kvp("application_id", request.application_id.str()),
+      kvp("requested_at", bsoncxx::types::b_date{now}),
+      kvp("expires_at", bsoncxx::types::b_date{now + ALERT_RUN_REQUEST_TTL})
+   ));
+
+   return result.has_value();
+}
+
+/// @brief Take the oldest unclaimed request to run alerts, so only one node acts on it
+/// @return Request, or empty if there are none waiting
+std::optional<alert_run_request> Database::claim_alert_run_request(const std::string& node_id) {
+   auto client = acquire();
+   auto db = client.coordination();
+
+   mongocxx::options::find_one_and_update opts;
+   opts.sort(make_document(kvp("requested_at", 1)));
+   auto claimed = db[ALERT_RUN_REQUEST_COL].find_one_and_update(make_document(
+      kvp("claimed_by", make_document(kvp("$exists", false))),
+      kvp("expires_at", make_document(kvp("$gt", bsoncxx::types::b_date{std::chrono::system_clock::now()})))
+   ), make_document(
+      kvp("$set", make_document(
+         kvp("claimed_by", node_id)
+      ))
+   ), opts);
+   if (!claimed.has_value()) {
+      return {};
+   }
+
+   auto doc = claimed.value().view();
+   return alert_run_request{
+      bson_to_string(doc["interaction_token"]),
+      dpp::snowflake(bson_to_string(doc["application_id"]))
+   };
+}
@@ -0,0 +1,63 @@
+#include <spdlog/spdlog.h>
+
+#include "choretracker/delay_queue.h"
+
+DelayQueue::DelayQueue() {
+    thread = std::thread(&DelayQueue::thread_task, this);
+}
+
+DelayQueue::~DelayQueue() {
+    stop();
+}
+
+void DelayQueue::schedule(std::chrono::steady_clock::duration delay, std::function<void()> task) {
+    {
+        std::lock_guard lock(mutex);
+        if (stopping) {
+            return;
+        }
+        tasks.emplace(std::chrono::steady_clock::now() + delay, std::move(task));
+    }
+    cv.notify_one();
+}
+
+void DelayQueue::stop() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void DelayQueue::thread_task() {
+    std::unique_lock lock(mutex);
+    while (true) {
+        if (tasks.empty()) {
+            if (stopping) {
+                return;
+            }
+            cv.wait(lock);
+            continue;
+        }
+
+        auto next = tasks.begin();
+        if (next->first > std::chrono::steady_clock::now()) {
+            cv.wait_until(lock, next->first);
+            continue;
+        }
+
+        auto task = std::move(next->second);
+        tasks.erase(next);
+        lock.unlock();
+        try {
+            task();
+        } catch (const std::exception& e) {
+            spdlog::error("Delayed task failed: {}", e.what());
+        }
+        lock.lock();
+    }
+}
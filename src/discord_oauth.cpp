@@ -1,10 +1,23 @@
 #include <httplib.h>
 #include <spdlog/spdlog.h>
+#include <spdlog/fmt/chrono.h>
 #include <format>
 
 #include "choretracker/discord_oauth.h"
+#include "choretracker/metrics.h"
 
-#define DISCORD_API_BASE_URL "https://discord.com"
+#define OAUTH_LATENCY_METRIC "oauth_request_duration_ms"
+#define OAUTH_LATENCY_HELP "Time spent in Discord OAuth calls"
+
+/// @brief Record how long a Discord API call took
+/// @param call Short name of the call, for the log
+/// @param latency The call's latency metric
+/// @param start When the call started
+void record_call_latency(const char* call, Summary& latency, std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    spdlog::debug("Discord OAuth call: call='{}' latency={}", call, elapsed);
+    latency.observe(elapsed.count());
+}
 
 std::string DiscordOAuth::generate_authorize_url() {
     return "https://discord.com/api/oauth2/authorize" +
@@ -16,7 +29,6 @@ std::string DiscordOAuth::generate_authorize_url() {
 }
 
 std::optional<nlohmann::json> DiscordOAuth::exchange_code_for_token(const std::string& code) {
-    httplib::Client client(DISCORD_API_BASE_URL);
     httplib::Params params;
     params.emplace("client_id", client_id);
     params.emplace("client_secret", client_secret);
@@ -24,32 +36,37 @@ std::optional<nlohmann::json> DiscordOAuth::exchange_code_for_token(const std::s
     params.emplace("code", code);
     params.emplace("redirect_uri", redirect_uri);
 
-    auto res = client.Post("/api/oauth2/token", params);
+    static auto& latency = metrics_summary(OAUTH_LATENCY_METRIC "{call=\"token\"}", OAUTH_LATENCY_HELP);
+    auto start = std::chrono::steady_clock::now();
+    auto res = clients.acquire()->Post("/api/oauth2/token", params);
+    record_call_latency("token", latency, start);
     if (res && res->status == httplib::StatusCode::OK_200) {
         return nlohmann::json::parse(res->body);
     } else {
         if (!res) {
-            spdlog::error(std::format("Exception exchanging code: {}", httplib::to_string(res.error())));
+            spdlog::error("Exception exchanging code: {}", httplib::to_string(res.error()));
         } else {
-            spdlog::error(std::format("Exception exchanging code: {}", res->body));
+            spdlog::error("Exception exchanging code: {}", res->body);
         }
         return {};
     }
 }
 
 std::optional<nlohmann::json> DiscordOAuth::get_user_info(const std::string& access_token) {
-    httplib::Client client(DISCORD_API_BASE_URL);
     httplib::Headers headers;
     headers.emplace("Authorization", std::format("Bearer {}", access_token));
 
-    auto res = client.Get("/api/users/@me", headers);
+    static auto& latency = metrics_summary(OAUTH_LATENCY_METRIC "{call=\"user_info\"}", OAUTH_LATENCY_HELP);
+    auto start = std::chrono::steady_clock::now();
+    auto res = clients.acquire()->Get("/api/users/@me", headers);
+    record_call_latency("user_info", latency, start);
     if (res && res->status == httplib::StatusCode::OK_200) {
         return nlohmann::json::parse(res->body);
     } else {
         if (!res) {
-            spdlog::error(std::format("Exception getting user info: {}", httplib::to_string(res.error())));
+            spdlog::error("Exception getting user info: {}", httplib::to_string(res.error()));
         } else {
-            spdlog::error(std::format("Exception getting user info: {}", res->body));
+            spdlog::error("Exception getting user info: {}", res->body);
         }
         return {};
     }
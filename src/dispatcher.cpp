@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/chrono.h>
+
+#include "choretracker/dispatcher.h"
+
+// Base delay for retrying 5xx and transport failures, doubled each attempt
+#define RETRY_BASE_DELAY std::chrono::seconds(2)
+#define RETRY_MAX_DELAY std::chrono::minutes(5)
+// Doublings past this are well over the max delay anyway, and dm_max_attempts can be set high enough to overflow the shift
+#define RETRY_MAX_DOUBLINGS 16
+// How often to log a throughput summary while the queue is busy
+#define THROUGHPUT_LOG_INTERVAL std::chrono::seconds(30)
+
+AlertDispatcher::AlertDispatcher(Database& db, dpp::cluster& bot) : db(db), bot(bot),
+        queue_depth(metrics_gauge("alert_dispatch_queue_depth", "Alert DMs waiting to be sent, including retries")),
+        sent_total(metrics_counter("alert_dispatch_sent_total", "Alert DMs delivered")),
+        failed_total(metrics_counter("alert_dispatch_failed_total", "Alert DMs given up on")),
+        retried_total(metrics_counter("alert_dispatch_retried_total", "Alert DM send attempts that were retried")),
+        rate_limited_total(metrics_counter("alert_dispatch_rate_limited_total", "Alert DM sends rejected with 429")) {}
+
+void AlertDispatcher::begin() {
+    // Warm the DM channel map so alerts can post straight to known channels
+    {
+        std::lock_guard lock(mutex);
+        for (const auto& settings : db.list_user_settings()) {
+            if (!settings.dm_channel_id.empty()) {
+                dm_channels[dpp::snowflake(settings.user_id)] = dpp::snowflake(settings.dm_channel_id);
+            }
+        }
+        spdlog::info("Loaded DM channels: count={}", dm_channels.size());
+    }
+
+    thread = std::thread(&AlertDispatcher::thread_task, this);
+    spdlog::info("Alert dispatcher started");
+}
+
+/// @brief Give queued DMs until the timeout to go out, then stop and hand back undelivered claims
+/// @param timeout Longest to wait for the queue to empty
+void AlertDispatcher::stop(std::chrono::seconds timeout) {
+    if (!thread.joinable()) {
+        return;
+    }
+
+    std::vector<dispatch_job> undelivered;
+    {
+        std::unique_lock lock(mutex);
+        cv.wait_for(lock, timeout, [this]() {
+            return ready.empty() && delayed.empty() && in_flight == 0;
+        });
+
+        stopping = true;
+        for (auto& job : ready) {
+            undelivered.push_back(std::move(job));
+        }
+        for (auto& pair : delayed) {
+            undelivered.push_back(std::move(pair.second));
+        }
+        ready.clear();
+        delayed.clear();
+        update_depth();
+    }
+    cv.notify_all();
+    thread.join();
+
+    // Let whoever runs alerts next pick these users up again
+    for (const auto& job : undelivered) {
+        if (job.claim_date.has_value()) {
+            db.release_user_alert(job.user_id.str(), job.claim_date.value());
+        }
+    }
+    spdlog::info("Alert dispatcher stopped: undelivered={}", undelivered.size());
+}
+
+void AlertDispatcher::enqueue(const dpp::snowflake& user_id, const dpp::message& message, 
+        const std::optional<std::chrono::year_month_day>& claim_date) {
+    {
+        std::lock_guard lock(mutex);
+        ready.push_back({ user_id, message, claim_date });
+        update_depth();
+    }
+    cv.notify_all();
+}
+
+void AlertDispatcher::thread_task() {
+    auto next_send = clock::now();
+    auto last_log = clock::now();
+    auto last_sent = sent_total.get();
+
+    std::unique_lock lock(mutex);
+    while (!stopping) {
+        auto now = clock::now();
+        // Rate is reloadable, so pick it up each time around
+        const int rate_per_second = config_get()->dm_rate_per_second;
+
+        // Retries whose delay has passed rejoin the back of the queue
+        while (!delayed.empty() && delayed.begin()->first <= now) {
+            ready.push_back(std::move(delayed.begin()->second));
+            delayed.erase(delayed.begin());
+        }
+
+        if (now - last_log >= THROUGHPUT_LOG_INTERVAL) {
+            auto sent = sent_total.get();
+            if (sent != last_sent || !ready.empty() || !delayed.empty()) {
+                auto seconds = std::chrono::duration<double>(now - last_log).count();
+                spdlog::info("Alert dispatch: depth={} in_flight={} throughput={:.1f}/s", 
+                    ready.size() + delayed.size(), in_flight, (sent - last_sent) / seconds);
+            }
+            last_sent = sent;
+            last_log = now;
+        }
+
+        // Cap in-flight requests so responses can update bucket state before we overrun it
+        if (ready.empty() || in_flight >= static_cast<size_t>(rate_per_second)) {
+            // Wait for new work, a response, or the next retry to come due
+            auto wake_time = delayed.empty() ? now + THROUGHPUT_LOG_INTERVAL : delayed.begin()->first;
+            cv.wait_until(lock, wake_time);
+            continue;
+        }
+
+        // Pace sends steadily, and respect any global rate limit pause
+        auto send_time = std::max(next_send, global_pause_until);
+        if (send_time > now) {
+            cv.wait_until(lock, send_time);
+            continue;
+        }
+
+        auto job = std::move(ready.front());
+        ready.pop_front();
+
+        // Hold back users whose route bucket is known to be exhausted
+        auto bucket_it = user_buckets.find(job.user_id);
+        if (bucket_it != user_buckets.end()) {
+            auto& bucket = buckets[bucket_it->second];
+            if (bucket.remaining == 0 && bucket.reset_at > now) {
+                delayed.emplace(bucket.reset_at, std::move(job));
+                continue;
+            }
+        }
+
+        job.attempts++;
+        in_flight++;
+        next_send = now + std::chrono::duration_cast<clock::duration>(std::chrono::seconds(1)) / rate_per_second;
+
+        auto channel_it = dm_channels.find(job.user_id);
+        auto channel_id = channel_it != dm_channels.end() ? channel_it->second : dpp::snowflake();
+
+        lock.unlock();
+        if (config_get()->discord_rest_stubbed) {
+            // Replay target, so count it as sent without it reaching the user
+            spdlog::debug("Alert DM stubbed: user_id='{}'", job.user_id.str());
+            dpp::confirmation_callback_t result;
+            result.http_info.status = 204;
+            on_result(std::move(job), result);
+        } else if (channel_id.empty()) {
+            send_via_new_channel(std::move(job));
+        } else {
+            send_to_channel(std::move(job), channel_id);
+        }
+        lock.lock();
+    }
+}
+
+void AlertDispatcher::send_to_channel(dispatch_job job, const dpp::snowflake& channel_id) {
+    auto message = job.message;
+    message.set_channel_id(channel_id);
+
+    bot.message_create(message, [this, job = std::move(job)](const dpp::confirmation_callback_t& result) mutable {
+        // The stored channel is gone, so forget it and open a fresh one
+        if (result.is_error() && result.http_info.status == 404) {
+            spdlog::debug("Stored DM channel not found, recreating: user_id='{}'", job.user_id.str());
+            {
+                std::lock_guard lock(mutex);
+                dm_channels.erase(job.user_id);
+            }
+            send_via_new_channel(std::move(job));
+            return;
+        }
+
+        on_result(std::move(job), result);
+    });
+}
+
+void AlertDispatcher::send_via_new_channel(dispatch_job job) {
+    bot.create_dm_channel(job.user_id, [this, job = std::move(job)](const dpp::confirmation_callback_t& result) mutable {
+        if (result.is_error()) {
+            on_result(std::move(job), result);
+            return;
+        }
+
+        auto channel_id = std::get<dpp::channel>(result.value).id;
+        {
+            std::lock_guard lock(mutex);
+            dm_channels[job.user_id] = channel_id;
+        }
+        db.set_dm_channel(job.user_id.str(), channel_id.str());
+
+        send_to_channel(std::move(job), channel_id);
+    });
+}
+
+void AlertDispatcher::on_result(dispatch_job job, const dpp::confirmation_callback_t& result) {
+    const auto& http = result.http_info;
+    auto now = clock::now();
+
+    {
+        std::lock_guard lock(mutex);
+        in_flight--;
+
+        // Track the route bucket this user's DMs land in
+        if (!http.ratelimit_bucket.empty()) {
+            buckets[http.ratelimit_bucket] = { http.ratelimit_remaining, now + std::chrono::seconds(http.ratelimit_reset_after) };
+            user_buckets[job.user_id] = http.ratelimit_bucket;
+        }
+        if (http.status == 429 && http.ratelimit_global) {
+            global_pause_until = std::max(global_pause_until, now + std::chrono::seconds(std::max<uint64_t>(http.ratelimit_retry_after, 1)));
+        }
+    }
+
+    if (!result.is_error()) {
+        sent_total.inc();
+        db.record_alert_delivery(job.user_id.str(), true, "");
+    } else if (http.status == 429) {
+        // Rate limits aren't the user's fault, so don't count them against the attempts
+        rate_limited_total.inc();
+        job.attempts--;
+        retry_later(std::move(job), std::chrono::seconds(std::max<uint64_t>(http.ratelimit_retry_after, 1)));
+    } else if ((http.status == 0 || http.status >= 500) && job.attempts < config_get()->dm_max_attempts) {
+        auto delay = std::min<clock::duration>(RETRY_BASE_DELAY * (1 << std::min(job.attempts - 1, RETRY_MAX_DOUBLINGS)), RETRY_MAX_DELAY);
+        spdlog::warn("Alert DM failed, retrying: user_id='{}' status={} attempt={} delay={}", 
+            job.user_id.str(), http.status, job.attempts, std::chrono::duration_cast<std::chrono::seconds>(delay));
+        retried_total.inc();
+        retry_later(std::move(job), delay);
+    } else {
+        auto error = result.get_error().message;
+        spdlog::error("Alert DM failed: user_id='{}' status={} attempts={} error='{}'", 
+            job.user_id.str(), http.status, job.attempts, error);
+        failed_total.inc();
+        db.record_alert_delivery(job.user_id.str(), false, error);
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        update_depth();
+    }
+    cv.notify_all();
+}
+
+void AlertDispatcher::retry_later(dispatch_job job, clock::duration delay) {
+    std::lock_guard lock(mutex);
+    delayed.emplace(clock::now() + delay, std::move(job));
+}
+
+void AlertDispatcher::update_depth() {
+    queue_depth.set(ready.size() + delayed.size() + in_flight);
+}
@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#include "choretracker/http_pool.h"
+
+HttpClientPool::HttpClientPool(const std::string& base_url, size_t max_size, 
+        std::chrono::milliseconds connect_timeout, std::chrono::milliseconds read_timeout)
+        : base_url(base_url), max_size(std::max<size_t>(max_size, 1)), connect_timeout(connect_timeout), read_timeout(read_timeout) {}
+
+/// @brief Borrow a client, creating one if under the limit or waiting for one to be returned
+/// @return Lease that returns the client to the pool when destroyed
+HttpClientPool::lease HttpClientPool::acquire() {
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [this]() { return !idle.empty() || created < max_size; });
+
+    if (!idle.empty()) {
+        auto client = std::move(idle.back());
+        idle.pop_back();
+        return lease(*this, std::move(client));
+    }
+
+    created++;
+    lock.unlock();
+    return lease(*this, create());
+}
+
+std::unique_ptr<httplib::Client> HttpClientPool::create() {
+    spdlog::debug("Creating HTTP client: base_url='{}'", base_url);
+
+    auto client = std::make_unique<httplib::Client>(base_url);
+    client->set_keep_alive(true);
+    client->set_connection_timeout(connect_timeout);
+    client->set_read_timeout(read_timeout);
+    client->set_write_timeout(read_timeout);
+
+    return client;
+}
+
+void HttpClientPool::release(std::unique_ptr<httplib::Client> client) {
+    {
+        std::lock_guard lock(mutex);
+        idle.push_back(std::move(client));
+    }
+    cv.notify_one();
+}
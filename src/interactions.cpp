@@ -0,0 +1,86 @@
+#include <optional>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#include "choretracker/interactions.h"
+#include "choretracker/utils.hpp"
+
+InteractionVerifier::InteractionVerifier(const std::string& public_key_hex) : key(nullptr, &EVP_PKEY_free) {
+    auto key_bytes = hex_decode(public_key_hex);
+    if (!key_bytes.has_value() || key_bytes->size() != ED25519_PUBLIC_KEY_SIZE) {
+        spdlog::error("Interactions public key is not a 32 byte hex string");
+        return;
+    }
+
+    key.reset(EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, key_bytes->data(), key_bytes->size()));
+    if (!key) {
+        spdlog::error("Failed to load interactions public key");
+    }
+}
+
+bool InteractionVerifier::verify(const std::string& timestamp, const std::string& body, const std::string& signature_hex) const {
+    if (!key) {
+        return false;
+    }
+
+    auto signature = hex_decode(signature_hex);
+    if (!signature.has_value() || signature->size() != ED25519_SIGNATURE_SIZE) {
+        return false;
+    }
+
+    // Ed25519 signs the message in one shot, so no digest is set
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+    if (!ctx || EVP_DigestVerifyInit(ctx.get(), nullptr, nullptr, nullptr, key.get()) != 1) {
+        return false;
+    }
+
+    std::string message = timestamp + body;
+    return EVP_DigestVerify(ctx.get(), signature->data(), signature->size(),
+        reinterpret_cast<const unsigned char*>(message.data()), message.size()) == 1;
+}
+
+InteractionSigner::InteractionSigner(const std::string& private_key_hex) : key(nullptr, &EVP_PKEY_free) {
+    auto key_bytes = hex_decode(private_key_hex);
+    if (!key_bytes.has_value() || key_bytes->size() != ED25519_PRIVATE_KEY_SIZE) {
+        spdlog::error("Interactions signing key is not a 32 byte hex string");
+        return;
+    }
+
+    key.reset(EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr, key_bytes->data(), key_bytes->size()));
+    if (!key) {
+        spdlog::error("Failed to load interactions signing key");
+    }
+}
+
+std::string InteractionSigner::public_key() const {
+    if (!key) {
+        return "";
+    }
+
+    std::vector<unsigned char> public_key(ED25519_PUBLIC_KEY_SIZE);
+    size_t size = public_key.size();
+    if (EVP_PKEY_get_raw_public_key(key.get(), public_key.data(), &size) != 1) {
+        return "";
+    }
+    return hex_encode(public_key);
+}
+
+std::string InteractionSigner::sign(const std::string& timestamp, const std::string& body) const {
+    if (!key) {
+        return "";
+    }
+
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+    if (!ctx || EVP_DigestSignInit(ctx.get(), nullptr, nullptr, nullptr, key.get()) != 1) {
+        return "";
+    }
+
+    std::string message = timestamp + body;
+    std::vector<unsigned char> signature(ED25519_SIGNATURE_SIZE);
+    size_t size = signature.size();
+    if (EVP_DigestSign(ctx.get(), signature.data(), &size,
+            reinterpret_cast<const unsigned char*>(message.data()), message.size()) != 1) {
+        return "";
+    }
+    return hex_encode(signature);
+}
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <format>
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/chrono.h>
+
+#include "choretracker/jobs.h"
+#include "choretracker/metrics.h"
+
+JobExecutor::JobExecutor() {
+    thread = std::thread(&JobExecutor::thread_task, this);
+}
+
+JobExecutor::~JobExecutor() {
+    stop();
+}
+
+bool JobExecutor::submit(const std::string& name, job_work work, job_listener listener) {
+    static auto& coalesced_total = metrics_counter("jobs_coalesced_total", "Job triggers folded into a run already queued");
+
+    std::unique_lock lock(mutex);
+    if (stopping) {
+        return false;
+    }
+
+    // Join an identical queued job rather than running it twice. A running one may already be
+    // past work this trigger needs done, so that gets a single follow-up run queued behind it
+    std::shared_ptr<job> existing;
+    auto it = std::find_if(queue.begin(), queue.end(), [&name](const auto& queued) {
+        return queued->status.name == name;
+    });
+    if (it != queue.end()) {
+        existing = *it;
+    }
+    if (existing) {
+        existing->status.coalesced++;
+        existing->listeners.push_back(listener);
+        auto status = existing->status;
+        lock.unlock();
+
+        coalesced_total.inc();
+        if (listener) {
+            listener(status);
+        }
+        return false;
+    }
+
+    auto queued = std::make_shared<job>();
+    queued->status.name = name;
+    queued->status.state = job_state::queued;
+    queued->work = std::move(work);
+    queued->listeners.push_back(listener);
+    queue.push_back(queued);
+    auto status = queued->status;
+    lock.unlock();
+
+    cv.notify_one();
+    if (listener) {
+        listener(status);
+    }
+    return true;
+}
+
+void JobExecutor::stop() {
+    {
+        std::lock_guard lock(mutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+        queue.clear();
+    }
+    cv.notify_all();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+/// @brief Tell the job's listeners where it's at, at most once per JOB_PROGRESS_INTERVAL unless forced
+void JobExecutor::notify(job& job, bool force) {
+    std::unique_lock lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    if (!force && now - job.last_report < JOB_PROGRESS_INTERVAL) {
+        return;
+    }
+    job.last_report = now;
+
+    // Listeners can be added by submit() while we call them, so work from a copy
+    auto status = job.status;
+    auto listeners = job.listeners;
+    lock.unlock();
+
+    for (const auto& listener : listeners) {
+        if (listener) {
+            listener(status);
+        }
+    }
+}
+
+void JobExecutor::thread_task() {
+    std::unique_lock lock(mutex);
+    while (true) {
+        cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+
+        running = queue.front();
+        queue.pop_front();
+        running->status.state = job_state::running;
+        auto current = running;
+        lock.unlock();
+
+        spdlog::info("Job started: job='{}'", current->status.name);
+        notify(*current, true);
+
+        auto start = std::chrono::steady_clock::now();
+        auto progress = [this, current, start](size_t done, size_t total) {
+            {
+                std::lock_guard lock(mutex);
+                current->status.done = done;
+                current->status.total = total;
+                current->status.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            }
+            notify(*current, false);
+        };
+
+        job_state result = job_state::succeeded;
+        std::string error;
+        try {
+            current->work(progress);
+        } catch (const std::exception& e) {
+            result = job_state::failed;
+            error = e.what();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+        lock.lock();
+        current->status.state = result;
+        current->status.error = error;
+        current->status.elapsed = elapsed;
+        running.reset();
+        lock.unlock();
+
+        metrics_counter(std::format("jobs_total{{job=\"{}\",result=\"{}\"}}", current->status.name,
+            result == job_state::succeeded ? "succeeded" : "failed"), "Background jobs run").inc();
+        if (result == job_state::succeeded) {
+            spdlog::info("Job finished: job='{}' elapsed={}", current->status.name, elapsed);
+        } else {
+            spdlog::error("Job failed: job='{}' elapsed={} error='{}'", current->status.name, elapsed, error);
+        }
+        notify(*current, true);
+
+        lock.lock();
+    }
+}
@@ -0,0 +1,54 @@
+#include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "choretracker/logging.h"
+
+#define LOGGER_NAME "choretracker"
+
+static spdlog::async_overflow_policy parse_overflow_policy(const std::string& policy) {
+    if (policy == "overrun_oldest") {
+        return spdlog::async_overflow_policy::overrun_oldest;
+    } else if (policy == "discard_new") {
+        return spdlog::async_overflow_policy::discard_new;
+    }
+    return spdlog::async_overflow_policy::block;
+}
+
+/// @brief Replace the default logger, moving formatting and writes off the calling thread if configured
+/// @param config Startup config
+/// @param use_stderr Log to stderr rather than stdout
+void logging_init(const config_snapshot& config, bool use_stderr) {
+    spdlog::sink_ptr sink;
+    if (use_stderr) {
+        sink = std::make_shared<spdlog::sinks::stderr_color_sink_mt>();
+    } else {
+        sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    }
+
+    std::shared_ptr<spdlog::logger> logger;
+    if (config.log_async) {
+        // A single worker drains a bounded ring buffer, callers only pay for the enqueue
+        spdlog::init_thread_pool(config.log_queue_size, 1);
+        logger = std::make_shared<spdlog::async_logger>(LOGGER_NAME, sink, spdlog::thread_pool(),
+            parse_overflow_policy(config.log_overflow_policy));
+    } else {
+        logger = std::make_shared<spdlog::logger>(LOGGER_NAME, sink);
+    }
+
+    // Picks up levels already loaded from SPDLOG_LEVEL and the config file
+    spdlog::drop(LOGGER_NAME);
+    spdlog::initialize_logger(logger);
+    spdlog::set_default_logger(logger);
+}
+
+/// @brief Flush anything still queued, call before exiting
+void logging_shutdown() {
+    if (auto pool = spdlog::thread_pool()) {
+        auto dropped = pool->overrun_counter() + pool->discard_counter();
+        if (dropped > 0) {
+            spdlog::warn("Log messages dropped by a full queue: dropped={}", dropped);
+        }
+    }
+    spdlog::shutdown();
+}
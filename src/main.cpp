@@ -1,73 +1,392 @@
 #include <format>
+#include <fstream>
 #include <iostream>
 #include <optional>
 #include <string>
-#include <future>
+#include <vector>
+#include <chrono>
+#include <cstring>
 #include <csignal>
+#include <pthread.h>
 
 #include <spdlog/spdlog.h>
+#include <spdlog/fmt/chrono.h>
 #include <spdlog/cfg/env.h>
 
 #include "choretracker/config.h"
 #include "choretracker/web.h"
 #include "choretracker/db.h"
+#include "choretracker/logging.h"
 #include "choretracker/bot.h"
+#include "choretracker/capture.h"
+#include "choretracker/replay.h"
+#include "choretracker/task_events.h"
+#include "choretracker/transfer.h"
 
-std::promise<void> thread_wait;
+#define USAGE "Usage: {} [--role web,bot,alerter] | export [file] | import [file] | replay <trace> --target <url> --db <uri> [--speed n] [--force]"
 
-void graceful_shutdown(int signal) {
-    spdlog::info(std::format("Received signal: {}", signal));
-    thread_wait.set_value();
+/// @brief Which subsystems this process runs, so each tier can be scaled on its own
+struct process_roles {
+    // Web UI, API and the interactions endpoint
+    bool web = false;
+    // Gateway connection taking slash commands
+    bool bot = false;
+    // Alert scheduler and DM sender
+    bool alerter = false;
+};
+
+/// @brief Parse a comma separated list of roles, e.g. "web,alerter"
+std::optional<process_roles> parse_roles(const std::string& value) {
+    process_roles roles;
+    size_t start = 0;
+    while (start <= value.size()) {
+        auto end = value.find(',', start);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        auto role = value.substr(start, end - start);
+        if (role == "web") {
+            roles.web = true;
+        } else if (role == "bot") {
+            roles.bot = true;
+        } else if (role == "alerter") {
+            roles.alerter = true;
+        } else {
+            return std::nullopt;
+        }
+        start = end + 1;
+    }
+    return roles;
+}
+
+/// @brief Read --role from the command line, all roles if it isn't given
+std::optional<process_roles> get_roles(int argc, char const *argv[]) {
+    std::optional<std::string> value;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--role" && i + 1 < argc) {
+            value = argv[++i];
+        } else if (arg.starts_with("--role=")) {
+            value = arg.substr(std::strlen("--role="));
+        } else {
+            return std::nullopt;
+        }
+    }
+    if (!value.has_value()) {
+        return process_roles{ true, true, true };
+    }
+    return parse_roles(value.value());
+}
+
+/// @brief Log a missing required setting
+/// @return Whether the setting is present
+template <typename T>
+bool require_config(const std::optional<T>& value, const std::string& description) {
+    if (!value.has_value()) {
+        spdlog::error("{} not defined, exiting", description);
+        return false;
+    }
+    return true;
+}
+
+/// @brief Shut down in dependency order, letting in-flight work finish
+/// @param signal Signal that triggered the shutdown
+/// @param web Web server, null if this process doesn't run one
+/// @param bot Bot, null if this process doesn't run one
+/// @param writer Task writer, null if this process doesn't write tasks
+void graceful_shutdown(int signal, Web* web, Bot* bot, TaskWriter* writer) {
+    auto config = config_get();
+    auto timeout = std::chrono::seconds(config->shutdown_drain_seconds);
+    spdlog::info("Received signal: {}, shutting down (timeout={})", signal, timeout);
+
+    // New web requests (and the readiness probe) now get a 503, so the load balancer
+    // moves traffic to other replicas while in-flight requests and their DB work finish
+    if (web) {
+        web->drain(timeout, std::chrono::seconds(config->shutdown_grace_seconds));
+    }
+    // Stop alerting, flushing queued DMs and handing back claims for any that don't make it
+    if (bot) {
+        bot->stop(timeout);
+    }
+    if (web) {
+        web->stop();
+    }
+    // Anything still queued for Mongo stays on disk and is replayed on next start
+    if (writer) {
+        writer->stop();
+    }
+
+    spdlog::info("Shutdown complete");
+}
+
+/// @brief Pool and routing settings for the database client
+database_options get_database_options(const config_snapshot& config) {
+    return {
+        config.db_read_preference,
+        config.db_pool_min,
+        config.db_pool_max,
+        config.db_wait_queue_timeout_ms,
+        config.db_write_concern,
+        config.db_coordination_write_concern,
+        config.db_write_timeout_ms
+    };
+}
+
+/// @brief Intents and shard settings for the gateway connection
+gateway_options get_gateway_options(const config_snapshot& config) {
+    return {
+        gateway_intents_from_string(config.gateway_intents),
+        static_cast<uint32_t>(config.gateway_shard_count),
+        static_cast<uint32_t>(config.gateway_cluster_id),
+        static_cast<uint32_t>(config.gateway_cluster_count)
+    };
+}
+
+/// @brief Export or import tasks as NDJSON from the command line, then exit
+/// @param mode "export" or "import"
+/// @param path File to write or read, stdout/stdin if "-"
+int run_transfer(const std::string& mode, const std::string& path) {
+    auto config = config_get();
+    auto db_connection_string = config->db_connection;
+    if (!db_connection_string.has_value()) {
+        spdlog::error("DB connection string not defined, exiting");
+        return 1;
+    }
+    Database db(db_connection_string.value(), config->db_name, get_database_options(*config));
+
+    if (mode == "export") {
+        std::ofstream file;
+        if (path != "-") {
+            file.open(path, std::ios::binary);
+            if (!file) {
+                spdlog::error("Could not open export file: path='{}'", path);
+                return 1;
+            }
+        }
+        auto exported = export_tasks(db, path == "-" ? std::cout : file);
+        spdlog::info("Tasks exported: count={}", exported);
+    } else {
+        std::ifstream file;
+        if (path != "-") {
+            file.open(path, std::ios::binary);
+            if (!file) {
+                spdlog::error("Could not open import file: path='{}'", path);
+                return 1;
+            }
+        }
+        auto importer = import_tasks(db, path == "-" ? std::cin : file);
+        spdlog::info("Tasks imported: imported={} skipped={}", importer.imported(), importer.skipped());
+    }
+
+    return 0;
+}
+
+/// @brief Whether every host in a URL is this machine, e.g. "http://localhost:8080" or
+/// "mongodb://127.0.0.1:27017,[::1]:27018/?replicaSet=rs0"
+bool url_is_loopback(const std::string& url) {
+    auto scheme = url.find("://");
+    auto start = scheme == std::string::npos ? 0 : scheme + 3;
+    auto authority = url.substr(start, url.find_first_of("/?#", start) - start);
+    auto credentials = authority.rfind('@');
+    if (credentials != std::string::npos) {
+        authority = authority.substr(credentials + 1);
+    }
+    if (authority.empty()) {
+        return false;
+    }
+
+    size_t host_start = 0;
+    while (host_start <= authority.size()) {
+        auto host_end = authority.find(',', host_start);
+        if (host_end == std::string::npos) {
+            host_end = authority.size();
+        }
+        auto host = authority.substr(host_start, host_end - host_start);
+        if (host.starts_with('[')) {
+            host = host.substr(1, host.find(']') - 1);
+        } else {
+            host = host.substr(0, host.find(':'));
+        }
+        bool loopback_ipv4 = host.starts_with("127.") && host.find_first_not_of("0123456789.") == std::string::npos;
+        if (host != "localhost" && !loopback_ipv4 && host != "::1") {
+            return false;
+        }
+        host_start = host_end + 1;
+    }
+    return true;
+}
+
+/// @brief Replay a workload trace against a local instance, then exit
+///
+/// The target and its DB have to be given explicitly rather than coming from config,
+/// so a replay can't land on production by accident. Either being anywhere other than
+/// this machine needs --force. The target should run with discord_rest_stubbed, so the
+/// alerts and follow-ups the replay sets off don't reach real users.
+/// @param args Everything after "replay <trace>": --target, --db, --speed and --force
+int run_replay_mode(const std::string& path, const std::vector<std::string>& args) {
+    auto config = config_get();
+
+    replay_options options;
+    options.trace_path = path;
+    options.signing_key = config->replay_signing_key;
+    std::optional<std::string> db_connection_string;
+    std::string speed = "1";
+    bool force = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "--target" && i + 1 < args.size()) {
+            options.target = args[++i];
+        } else if (args[i] == "--db" && i + 1 < args.size()) {
+            db_connection_string = args[++i];
+        } else if (args[i] == "--speed" && i + 1 < args.size()) {
+            speed = args[++i];
+        } else if (args[i] == "--force") {
+            force = true;
+        } else {
+            spdlog::error("Unknown replay argument: argument='{}'", args[i]);
+            return 1;
+        }
+    }
+
+    if (options.target.empty() || !db_connection_string.has_value()) {
+        spdlog::error("Replay needs an explicit --target and --db");
+        return 1;
+    }
+    if (!force && !url_is_loopback(options.target)) {
+        spdlog::error("Replay target isn't on this machine, pass --force if that's intended: target='{}'", options.target);
+        return 1;
+    }
+    if (!force && (!url_is_loopback(db_connection_string.value()) || db_connection_string == config->db_connection)) {
+        spdlog::error("Replay DB isn't a local stand-in, pass --force if that's intended");
+        return 1;
+    }
+
+    try {
+        options.speed = std::stod(speed);
+    } catch (const std::exception&) {
+        options.speed = 0;
+    }
+    if (options.speed <= 0) {
+        spdlog::error("Replay speed must be a positive number: speed='{}'", speed);
+        return 1;
+    }
+
+    Database db(db_connection_string.value(), config->db_name, get_database_options(*config));
+    return run_replay(db, options);
 }
 
 int main(int argc, char const *argv[]) {
     spdlog::cfg::load_env_levels();
 
-    // TODO: Fix shutdown handler
-    
     // Ensure config file is loaded
     bool config_was_loaded = config_load_file();
+
+    // Command line modes keep stdout clean for their own output
+    std::string mode = argc >= 2 ? argv[1] : "";
+    bool cli_mode = mode == "export" || mode == "import" || mode == "replay";
+
+    // Block shutdown signals before any threads start (the async logger's included), so
+    // every thread inherits the mask and the signal is only picked up by sigwait() below.
+    // Command line modes keep the default, so Ctrl+C still stops them
+    sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    if (!cli_mode) {
+        pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr);
+    }
+
+    logging_init(*config_get(), cli_mode);
+
     if (config_was_loaded) {
         spdlog::info("Config file loaded");
     } else {
         spdlog::info("Config not found, will use env vars");
     }
 
-    // Find the bot token or quit
-    auto bot_token = config_get_str(CONFIG_BOT_TOKEN);
-    if (!bot_token.has_value()) {
-        spdlog::error("Bot token not defined, exiting");
-        exit(1);
+    // choretracker export|import [file]
+    if (mode == "export" || mode == "import") {
+        int result = run_transfer(mode, argc >= 3 ? argv[2] : "-");
+        logging_shutdown();
+        return result;
     }
 
-    auto db_connection_string = config_get_str(CONFIG_DB_CONNECTION);
-    if (!db_connection_string.has_value()) {
-        spdlog::error("DB connection string not defined, exiting");
-        exit(1);
+    // choretracker replay <trace> --target <url> --db <uri> [--speed n] [--force]
+    if (mode == "replay") {
+        int result = 1;
+        if (argc >= 3) {
+            result = run_replay_mode(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+        } else {
+            std::cerr << std::format(USAGE, argv[0]) << std::endl;
+        }
+        logging_shutdown();
+        return result;
     }
 
-    auto discord_client_id = config_get_str(CONFIG_DISCORD_CLIENT_ID);
-    if (!discord_client_id.has_value()) {
-        spdlog::error("Discord client ID not defined, exiting");
-        exit(1);
+    // choretracker [--role web,bot,alerter]
+    auto roles = get_roles(argc, argv);
+    if (!roles.has_value()) {
+        std::cerr << std::format(USAGE, argv[0]) << std::endl;
+        logging_shutdown();
+        return 1;
     }
 
-    auto discord_client_secret = config_get_str(CONFIG_DISCORD_CLIENT_SECRET);
-    if (!discord_client_secret.has_value()) {
-        spdlog::error("Discord client secret not defined, exiting");
+    config_watch();
+    auto config = config_get();
+    capture_init(*config);
+
+    // Interactions over HTTP are answered by the web tier, so it needs a REST-only bot for them
+    bool web_interactions = roles->web && config->interactions_public_key.has_value();
+    bool needs_bot = roles->bot || roles->alerter || web_interactions;
+
+    // Check only what the chosen roles need, or quit
+    bool configured = require_config(config->db_connection, "DB connection string");
+    if (needs_bot) {
+        configured = require_config(config->bot_token, "Bot token") && configured;
+    }
+    if (roles->web) {
+        configured = require_config(config->discord_client_id, "Discord client ID") && configured;
+        configured = require_config(config->discord_client_secret, "Discord client secret") && configured;
+    }
+    if (!configured) {
+        exit(1);
+    }
+    if (config->discord_rest_stubbed && roles->bot) {
+        // The gateway connection itself goes to Discord, so a stubbed instance can't run it
+        spdlog::error("discord_rest_stubbed can't be used with the bot role, start with --role web,alerter");
         exit(1);
     }
+    spdlog::info("Starting roles: web={} bot={} alerter={}", roles->web, roles->bot, roles->alerter);
 
-    auto db_name = config_get_str(CONFIG_DB_NAME).value_or(DEFAULT_DB_NAME);
-    auto web_port = config_get_int(CONFIG_WEB_PORT).value_or(DEFAULT_WEB_PORT);
-    auto web_base_url = config_get_str(CONFIG_WEB_BASE_URL).value_or(DEFAULT_WEB_BASE_URL);
+    Database db(config->db_connection.value(), config->db_name, get_database_options(*config));
+    TaskEventHub events;
 
-    Database db(db_connection_string.value(), db_name);
-    Bot bot(bot_token.value(), db);
-    Web web(web_port, web_base_url, discord_client_id.value(), discord_client_secret.value(), db);
+    // Only commands and the web UI write tasks, alerting alone has nothing to queue
+    std::optional<TaskWriter> writer;
+    if (roles->web || roles->bot) {
+        try {
+            writer.emplace(db, events, config->write_queue_dir);
+        } catch (const std::exception& e) {
+            spdlog::error("Unable to start the write queue, exiting: {}", e.what());
+            exit(1);
+        }
+    }
+
+    std::optional<Bot> bot;
+    if (needs_bot) {
+        bot.emplace(config->bot_token.value(), bot_roles{ roles->bot, roles->alerter }, get_gateway_options(*config), db, events, writer ? &writer.value() : nullptr);
+    }
+    std::optional<Web> web;
+    if (roles->web) {
+        web.emplace(config->web_port, config->web_base_url, config->discord_client_id.value(), config->discord_client_secret.value(),
+            config->interactions_public_key, db, events, writer.value(), bot ? &bot.value() : nullptr);
+    }
 
-    // Sleep forever
-    thread_wait.get_future().get();
+    // Wait for a shutdown signal
+    int received_signal;
+    sigwait(&shutdown_signals, &received_signal);
+    graceful_shutdown(received_signal, web ? &web.value() : nullptr, bot ? &bot.value() : nullptr, writer ? &writer.value() : nullptr);
+    capture_shutdown();
+    logging_shutdown();
 
     return 0;
 }
@@ -0,0 +1,84 @@
+#include <format>
+
+#include "choretracker/metrics.h"
+
+#define METRICS_PREFIX "choretracker_"
+
+struct metric_family {
+    metric_type type;
+    std::string help;
+    std::map<std::string, std::unique_ptr<Metric>> series;
+    std::map<std::string, std::unique_ptr<Summary>> summaries;
+};
+
+static std::mutex metrics_mutex;
+static std::map<std::string, metric_family> metric_families;
+
+static Metric& metrics_register(const std::string& name, const std::string& help, metric_type type) {
+    auto family_name = name.substr(0, name.find('{'));
+
+    std::lock_guard lock(metrics_mutex);
+    auto& family = metric_families.try_emplace(family_name, metric_family{ type, help, {}, {} }).first->second;
+    auto& metric = family.series[name];
+    if (!metric) {
+        metric = std::make_unique<Metric>();
+    }
+
+    return *metric;
+}
+
+Metric& metrics_counter(const std::string& name, const std::string& help) {
+    return metrics_register(name, help, metric_type::counter);
+}
+
+Metric& metrics_gauge(const std::string& name, const std::string& help) {
+    return metrics_register(name, help, metric_type::gauge);
+}
+
+Summary& metrics_summary(const std::string& name, const std::string& help) {
+    auto family_name = name.substr(0, name.find('{'));
+
+    std::lock_guard lock(metrics_mutex);
+    auto& family = metric_families.try_emplace(family_name, metric_family{ metric_type::summary, help, {}, {} }).first->second;
+    auto& summary = family.summaries[name];
+    if (!summary) {
+        summary = std::make_unique<Summary>();
+    }
+
+    return *summary;
+}
+
+static const char* metric_type_name(metric_type type) {
+    switch (type) {
+        case metric_type::counter:
+            return "counter";
+        case metric_type::summary:
+            return "summary";
+        case metric_type::gauge:
+        default:
+            return "gauge";
+    }
+}
+
+/// @brief Render all metrics in the Prometheus text exposition format
+/// @return Metrics text
+std::string metrics_render() {
+    std::string output;
+
+    std::lock_guard lock(metrics_mutex);
+    for (const auto& [family_name, family] : metric_families) {
+        output += std::format("# HELP {}{} {}\n", METRICS_PREFIX, family_name, family.help);
+        output += std::format("# TYPE {}{} {}\n", METRICS_PREFIX, family_name, metric_type_name(family.type));
+        for (const auto& [name, metric] : family.series) {
+            output += std::format("{}{} {}\n", METRICS_PREFIX, name, metric->get());
+        }
+        for (const auto& [name, summary] : family.summaries) {
+            // Labels go after the suffix, e.g. name_sum{call="token"}
+            auto labels = name.substr(family_name.size());
+            output += std::format("{}{}_sum{} {}\n", METRICS_PREFIX, family_name, labels, summary->sum());
+            output += std::format("{}{}_count{} {}\n", METRICS_PREFIX, family_name, labels, summary->count());
+        }
+    }
+
+    return output;
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/chrono.h>
+
+#include "choretracker/partitions.h"
+#include "choretracker/utils.hpp"
+
+// Random UUID, the same as session cookies use
+std::string generate_session_token();
+
+PartitionCoordinator::PartitionCoordinator(Database& db, int partition_count, std::chrono::seconds lease_duration)
+        : db(db), node_id(generate_session_token()), partition_count(std::max(partition_count, 1)), lease_duration(lease_duration) {
+    spdlog::info("Alert partitioning: node_id='{}' partitions={} lease={}", node_id, this->partition_count, lease_duration);
+}
+
+/// @brief Renew our membership and leases, taking over or handing back partitions as needed
+/// @return Whether the set of partitions we own changed
+bool PartitionCoordinator::heartbeat() {
+    auto expires_at = std::chrono::system_clock::now() + lease_duration;
+    if (!db.heartbeat_node(node_id, expires_at)) {
+        // Our leases can lapse to other nodes from here on, so stop working them
+        spdlog::warn("Failed to heartbeat alerter node, dropping partitions");
+        return drop();
+    }
+
+    auto nodes = db.list_live_nodes();
+    // Our own heartbeat may not be visible yet on a lagging read
+    if (std::find(nodes.begin(), nodes.end(), node_id) == nodes.end()) {
+        nodes.push_back(node_id);
+    }
+    auto desired = assign_partitions(nodes);
+
+    std::set<int> owned;
+    for (int partition = 0; partition < partition_count; partition++) {
+        if (desired.contains(partition)) {
+            // Takes over lapsed leases from dead nodes, renews our own
+            if (db.acquire_partition_lease(partition, node_id, expires_at)) {
+                owned.insert(partition);
+            }
+        }
+    }
+
+    std::lock_guard lock(owned_mutex);
+    // Hand back anything the membership no longer assigns to us
+    for (int partition : owned_partitions) {
+        if (!desired.contains(partition)) {
+            db.release_partition_lease(partition, node_id);
+        }
+    }
+    bool changed = owned != owned_partitions;
+    if (changed) {
+        spdlog::info("Alert partitions rebalanced: nodes={} owned={}", nodes.size(), owned.size());
+    }
+    owned_partitions = std::move(owned);
+
+    return changed;
+}
+
+void PartitionCoordinator::leave() {
+    std::lock_guard lock(owned_mutex);
+    for (int partition : owned_partitions) {
+        db.release_partition_lease(partition, node_id);
+    }
+    owned_partitions.clear();
+    db.remove_node(node_id);
+}
+
+/// @brief Forget every partition we own without going to the DB, for when it can't be reached
+/// @return Whether we owned any
+bool PartitionCoordinator::drop() {
+    std::lock_guard lock(owned_mutex);
+    bool changed = !owned_partitions.empty();
+    if (changed) {
+        spdlog::warn("Alert partitions dropped: owned={}", owned_partitions.size());
+    }
+    owned_partitions.clear();
+    return changed;
+}
+
+bool PartitionCoordinator::owns_user(const dpp::snowflake& user_id) {
+    std::lock_guard lock(owned_mutex);
+    return owned_partitions.contains(partition_for(user_id));
+}
+
+int PartitionCoordinator::partition_for(const dpp::snowflake& user_id) const {
+    return static_cast<int>(fnv1a_hash(user_id.str()) % partition_count);
+}
+
+std::set<int> PartitionCoordinator::assign_partitions(const std::vector<std::string>& nodes) const {
+    // Rendezvous hashing: each partition goes to the node with the highest score,
+    // so only the dead/new node's partitions move when membership changes
+    std::set<int> assigned;
+    for (int partition = 0; partition < partition_count; partition++) {
+        const std::string* best_node = nullptr;
+        uint64_t best_score = 0;
+        for (const auto& node : nodes) {
+            auto score = fnv1a_hash(node, fnv1a_hash(std::to_string(partition)));
+            if (best_node == nullptr || score > best_score || (score == best_score && node < *best_node)) {
+                best_node = &node;
+                best_score = score;
+            }
+        }
+
+        if (best_node != nullptr && *best_node == node_id) {
+            assigned.insert(partition);
+        }
+    }
+
+    return assigned;
+}
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <functional>
+
+#include "choretracker/rate_limit.h"
+
+RateLimiter::RateLimiter(const std::string& name)
+    : allowed(metrics_counter(std::format("rate_limit_allowed_total{{limiter=\"{}\"}}", name), "Requests let through by the rate limiter")),
+    limited(metrics_counter(std::format("rate_limit_limited_total{{limiter=\"{}\"}}", name), "Requests turned away by the rate limiter")),
+    tracked(metrics_gauge(std::format("rate_limit_buckets{{limiter=\"{}\"}}", name), "Token buckets currently tracked")),
+    rate_gauge(metrics_gauge(std::format("rate_limit_per_second{{limiter=\"{}\"}}", name), "Configured tokens added per second")),
+    burst_gauge(metrics_gauge(std::format("rate_limit_burst{{limiter=\"{}\"}}", name), "Configured bucket size")) {
+}
+
+std::optional<std::chrono::milliseconds> RateLimiter::acquire(const std::string& key, int rate_per_second, int burst) {
+    rate_gauge.set(rate_per_second);
+    burst_gauge.set(burst);
+
+    auto now = std::chrono::steady_clock::now();
+    auto& shard = shards[std::hash<std::string>{}(key) % RATE_LIMIT_SHARDS];
+    std::lock_guard lock(shard.mutex);
+
+    if (shard.buckets.size() >= RATE_LIMIT_SWEEP_THRESHOLD && !shard.buckets.contains(key)) {
+        sweep(shard, now, rate_per_second, burst);
+    }
+    auto [it, inserted] = shard.buckets.try_emplace(key, bucket{ static_cast<double>(burst), now });
+    if (inserted) {
+        tracked.inc();
+    }
+
+    // Refill for the time since the bucket was last touched
+    auto& entry = it->second;
+    std::chrono::duration<double> elapsed = now - entry.updated;
+    entry.tokens = std::min(static_cast<double>(burst), entry.tokens + elapsed.count() * rate_per_second);
+    entry.updated = now;
+
+    if (entry.tokens >= 1.0) {
+        entry.tokens -= 1.0;
+        allowed.inc();
+        return {};
+    }
+
+    limited.inc();
+    auto wait_seconds = (1.0 - entry.tokens) / rate_per_second;
+    return std::chrono::milliseconds(static_cast<int64_t>(std::ceil(wait_seconds * 1000)));
+}
+
+/// @brief Drop buckets that would be full by now, they behave the same as a new bucket
+void RateLimiter::sweep(shard& shard, std::chrono::steady_clock::time_point now, int rate_per_second, int burst) {
+    auto removed = std::erase_if(shard.buckets, [now, rate_per_second, burst](const auto& item) {
+        std::chrono::duration<double> elapsed = now - item.second.updated;
+        return item.second.tokens + elapsed.count() * rate_per_second >= burst;
+    });
+    tracked.dec(removed);
+}
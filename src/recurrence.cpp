@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <format>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "choretracker/recurrence.h"
+
+// Distinct compiled rules kept for reuse, past this new rules are compiled each time
+#define RECURRENCE_CACHE_SIZE 4096
+
+static const std::array<std::string_view, 7> WEEKDAY_NAMES = {
+    "sunday", "monday", "tuesday", "wednesday", "thursday", "friday", "saturday"
+};
+
+/// @brief Lowercase words, split on spaces and commas, with "and" dropped
+static std::vector<std::string> tokenize(std::string_view text) {
+    std::vector<std::string> tokens;
+    std::string current;
+    for (char c : text) {
+        if (std::isspace(static_cast<unsigned char>(c)) || c == ',') {
+            if (!current.empty() && current != "and") {
+                tokens.push_back(std::move(current));
+            }
+            current.clear();
+        } else {
+            current += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    }
+    if (!current.empty() && current != "and") {
+        tokens.push_back(std::move(current));
+    }
+    return tokens;
+}
+
+static std::optional<int> parse_number(std::string_view token) {
+    int value = 0;
+    auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (ec != std::errc() || end != token.data() + token.size()) {
+        return {};
+    }
+    return value;
+}
+
+/// @brief "mon", "tues", "thursday", "fridays" and so on
+/// @return Weekday with Sunday as 0
+static std::optional<int> parse_weekday(std::string_view token) {
+    if (token.size() > 3 && token.ends_with('s')) {
+        token.remove_suffix(1);
+    }
+    if (token.size() < 3) {
+        return {};
+    }
+    for (int i = 0; i < 7; i++) {
+        if (WEEKDAY_NAMES[i].starts_with(token)) {
+            return i;
+        }
+    }
+    return {};
+}
+
+/// @brief "1", "1st", "22nd" or "last"
+/// @return Day of the month, 0 for the last day
+static std::optional<int> parse_month_day(std::string_view token) {
+    if (token == "last") {
+        return 0;
+    }
+    if (token.ends_with("st") || token.ends_with("nd") || token.ends_with("rd") || token.ends_with("th")) {
+        token.remove_suffix(2);
+    }
+    auto day = parse_number(token);
+    if (!day.has_value() || day.value() < 1 || day.value() > 31) {
+        return {};
+    }
+    return day;
+}
+
+static std::string ordinal(int day) {
+    if (day == 0) {
+        return "last day";
+    }
+    auto suffix = "th";
+    if (day % 10 == 1 && day != 11) {
+        suffix = "st";
+    } else if (day % 10 == 2 && day != 12) {
+        suffix = "nd";
+    } else if (day % 10 == 3 && day != 13) {
+        suffix = "rd";
+    }
+    return std::format("{}{}", day, suffix);
+}
+
+/// @brief "a", "a and b", "a, b and c"
+static std::string join_list(const std::vector<std::string>& items) {
+    std::string joined;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (i > 0) {
+            joined += i + 1 == items.size() ? " and " : ", ";
+        }
+        joined += items[i];
+    }
+    return joined;
+}
+
+std::optional<Recurrence> Recurrence::parse(std::string_view text) {
+    auto tokens = tokenize(text);
+    if (tokens.empty()) {
+        return {};
+    }
+
+    Recurrence rule;
+    auto interval = [&rule](int days) -> std::optional<Recurrence> {
+        if (days < 1 || days > RECURRENCE_MAX_INTERVAL_DAYS) {
+            return {};
+        }
+        rule.rule_kind = recurrence_kind::interval;
+        rule.interval_days = static_cast<uint16_t>(days);
+        return rule;
+    };
+
+    // daily, weekly, fortnightly
+    if (tokens.size() == 1) {
+        if (tokens[0] == "daily") return interval(1);
+        if (tokens[0] == "weekly") return interval(7);
+        if (tokens[0] == "fortnightly") return interval(14);
+    }
+
+    // every day, every other week, every 3 days, every 2 weeks
+    if (tokens[0] == "every" && tokens.size() <= 3) {
+        std::vector<std::string> rest(tokens.begin() + 1, tokens.end());
+        int multiplier = 1;
+        if (rest.size() == 2 && rest[0] == "other") {
+            multiplier = 2;
+            rest.erase(rest.begin());
+        } else if (rest.size() == 2) {
+            auto count = parse_number(rest[0]);
+            if (count.has_value()) {
+                // Bounded before it's scaled to weeks or fortnights, so that can't overflow
+                if (count.value() < 1 || count.value() > RECURRENCE_MAX_INTERVAL_DAYS) {
+                    return {};
+                }
+                multiplier = count.value();
+                rest.erase(rest.begin());
+            }
+        }
+        if (rest.size() == 1) {
+            if (rest[0] == "day" || rest[0] == "days") return interval(multiplier);
+            if (rest[0] == "week" || rest[0] == "weeks") return interval(multiplier * 7);
+            if (rest[0] == "fortnight") return interval(multiplier * 14);
+        }
+    }
+
+    // 1st of the month, 1st and 15th of every month, last day of the month, monthly on 1 and 15
+    if (tokens.back() == "month" || tokens[0] == "monthly") {
+        for (const auto& token : tokens) {
+            if (token == "monthly" || token == "month" || token == "on" || token == "of" || token == "the" ||
+                    token == "every" || token == "each" || token == "day") {
+                continue;
+            }
+            auto day = parse_month_day(token);
+            if (!day.has_value()) {
+                return {};
+            }
+            rule.month_days |= 1u << day.value();
+        }
+        if (rule.month_days == 0) {
+            return {};
+        }
+        rule.rule_kind = recurrence_kind::monthly;
+        return rule;
+    }
+
+    // every monday and thursday, weekly on mon, thu
+    if (tokens[0] != "every" && tokens[0] != "weekly") {
+        return {};
+    }
+    for (size_t i = 1; i < tokens.size(); i++) {
+        if (tokens[i] == "on") {
+            continue;
+        }
+        auto weekday = parse_weekday(tokens[i]);
+        if (!weekday.has_value()) {
+            return {};
+        }
+        rule.weekdays |= 1u << weekday.value();
+    }
+    if (rule.weekdays == 0) {
+        return {};
+    }
+    rule.rule_kind = recurrence_kind::weekly;
+    return rule;
+}
+
+/// @brief Work out the lookup tables and canonical text for a parsed rule
+void Recurrence::build_tables() {
+    switch (rule_kind) {
+        case recurrence_kind::interval:
+            if (interval_days % 7 == 0) {
+                canonical = interval_days == 7 ? "every week" : std::format("every {} weeks", interval_days / 7);
+            } else {
+                canonical = interval_days == 1 ? "every day" : std::format("every {} days", interval_days);
+            }
+            break;
+        case recurrence_kind::weekly: {
+            for (int weekday = 0; weekday < 7; weekday++) {
+                for (int ahead = 1; ahead <= 7; ahead++) {
+                    if (weekdays & (1u << ((weekday + ahead) % 7))) {
+                        weekday_next[weekday] = static_cast<uint8_t>(ahead);
+                        break;
+                    }
+                }
+            }
+
+            // Listed from Monday
+            std::vector<std::string> names;
+            for (int i = 1; i <= 7; i++) {
+                if (weekdays & (1u << (i % 7))) {
+                    names.emplace_back(WEEKDAY_NAMES[i % 7].substr(0, 3));
+                }
+            }
+            canonical = "every " + join_list(names);
+            break;
+        }
+        case recurrence_kind::monthly: {
+            for (unsigned length = 28; length <= 31; length++) {
+                // Days past the end of the month, and "last", fall on its last day
+                uint32_t effective = 0;
+                for (unsigned day = 1; day <= 31; day++) {
+                    if (month_days & (1u << day)) {
+                        effective |= 1u << std::min(day, length);
+                    }
+                }
+                if (month_days & 1u) {
+                    effective |= 1u << length;
+                }
+
+                auto& next = month_day_next[length - 28];
+                uint8_t upcoming = 0;
+                for (int day = static_cast<int>(length); day >= 0; day--) {
+                    next[day] = upcoming;
+                    if (effective & (1u << day)) {
+                        upcoming = static_cast<uint8_t>(day);
+                    }
+                }
+                month_day_first[length - 28] = next[0];
+            }
+
+            std::vector<std::string> days;
+            for (int day = 1; day <= 31; day++) {
+                if (month_days & (1u << day)) {
+                    days.push_back(ordinal(day));
+                }
+            }
+            if (month_days & 1u) {
+                days.push_back(ordinal(0));
+            }
+            canonical = join_list(days) + " of the month";
+            break;
+        }
+    }
+}
+
+std::shared_ptr<const Recurrence> Recurrence::compile(std::string_view text) {
+    static std::shared_mutex mutex;
+    // Keyed by canonical text, so other spellings of a rule share its entry instead of
+    // taking up their own. Stored rules are canonical, so they hit without a parse
+    static std::unordered_map<std::string, std::shared_ptr<const Recurrence>> cache;
+
+    {
+        std::shared_lock lock(mutex);
+        auto it = cache.find(std::string(text));
+        if (it != cache.end()) {
+            return it->second;
+        }
+    }
+
+    auto parsed = parse(text);
+    if (!parsed.has_value()) {
+        return nullptr;
+    }
+    parsed->build_tables();
+
+    std::unique_lock lock(mutex);
+    auto it = cache.find(parsed->canonical);
+    if (it != cache.end()) {
+        return it->second;
+    }
+    std::shared_ptr<const Recurrence> rule(new Recurrence(std::move(parsed.value())));
+    if (cache.size() < RECURRENCE_CACHE_SIZE) {
+        cache.emplace(rule->canonical, rule);
+    }
+    return rule;
+}
+
+std::chrono::sys_days Recurrence::next_due_after(std::chrono::sys_days date) const {
+    switch (rule_kind) {
+        case recurrence_kind::weekly:
+            return date + std::chrono::days(weekday_next[std::chrono::weekday(date).c_encoding()]);
+        case recurrence_kind::monthly: {
+            std::chrono::year_month_day ymd(date);
+            auto length = static_cast<unsigned>(std::chrono::year_month_day_last(ymd.year(), ymd.month() / std::chrono::last).day());
+            auto next_day = month_day_next[length - 28][static_cast<unsigned>(ymd.day())];
+            if (next_day != 0) {
+                return std::chrono::sys_days(ymd.year() / ymd.month() / next_day);
+            }
+
+            auto next_month = ymd.year() / ymd.month() + std::chrono::months(1);
+            auto next_length = static_cast<unsigned>(std::chrono::year_month_day_last(next_month.year(), next_month.month() / std::chrono::last).day());
+            return std::chrono::sys_days(next_month / month_day_first[next_length - 28]);
+        }
+        case recurrence_kind::interval:
+        default:
+            return date + std::chrono::days(interval_days);
+    }
+}
+
+int32_t Recurrence::nominal_days() const {
+    switch (rule_kind) {
+        case recurrence_kind::weekly:
+            return std::max(7 / std::popcount(weekdays), 1);
+        case recurrence_kind::monthly:
+            return std::max(30 / std::popcount(month_days), 1);
+        case recurrence_kind::interval:
+        default:
+            return interval_days;
+    }
+}
@@ -0,0 +1,183 @@
+#include <cctype>
+#include <format>
+#include <iterator>
+#include <spdlog/spdlog.h>
+
+#include "choretracker/render.h"
+
+/// @brief Writes formatted lines either into a buffer, or just counts their size
+///
+/// Rendering runs the same function twice: once measuring to find the exact output
+/// size, then again writing into a buffer reserved to that size.
+class message_writer {
+    public:
+        message_writer() : buffer(nullptr) {}
+        explicit message_writer(std::string& buffer) : buffer(&buffer) {}
+
+        template <typename... Args>
+        void line(std::format_string<Args...> fmt, Args&&... args) {
+            if (buffer != nullptr) {
+                std::format_to(std::back_inserter(*buffer), fmt, args...);
+                buffer->push_back('\n');
+            } else {
+                size += std::formatted_size(fmt, args...) + 1;
+            }
+        }
+
+        void blank_line() {
+            if (buffer != nullptr) {
+                buffer->push_back('\n');
+            } else {
+                size++;
+            }
+        }
+
+        size_t size = 0;
+    private:
+        std::string* buffer;
+};
+
+template <typename F>
+std::string render_exact(F&& render) {
+    message_writer measure;
+    render(measure);
+
+    std::string output;
+    output.reserve(measure.size);
+    message_writer writer(output);
+    render(writer);
+
+    return output;
+}
+
+/// @brief Split text into messages no longer than the limit, breaking on line boundaries
+/// @param text Text to split
+/// @param limit Maximum message length
+/// @return Messages, in order
+std::vector<std::string> split_message(std::string_view text, size_t limit) {
+    std::vector<std::string> messages;
+
+    while (!text.empty()) {
+        if (text.size() <= limit) {
+            messages.emplace_back(text);
+            break;
+        }
+
+        // Break after the last newline that fits, or hard-break a line that's too long by itself
+        auto cut = text.rfind('\n', limit - 1);
+        auto length = cut == std::string_view::npos ? limit : cut + 1;
+        if (cut == std::string_view::npos) {
+            // Back up to a code point boundary, so a multi-byte character isn't split across messages
+            while (length > 1 && (static_cast<unsigned char>(text[length]) & 0xC0) == 0x80) {
+                length--;
+            }
+        }
+        messages.emplace_back(text.substr(0, length));
+        text.remove_prefix(length);
+    }
+
+    return messages;
+}
+
+std::vector<std::string> render_task_list(const std::vector<task_definition>& tasks) {
+    bool has_repeated_tasks = false;
+    bool has_once_off_tasks = false;
+    for (const auto& task : tasks) {
+        if (task.type == task_type::once_off) {
+            has_once_off_tasks = true;
+        } else {
+            has_repeated_tasks = true;
+        }
+    }
+
+    auto message = render_exact([&](message_writer& out) {
+        if (has_repeated_tasks) {
+            out.line("Tasks: ");
+            for (const auto& task : tasks) {
+                switch (task.type) {
+                    case task_type::regular:
+                        if (task.recurrence) {
+                            auto schedule = task.recurrence->text();
+                            schedule[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(schedule[0])));
+                            out.line("{} - {} - Last performed {}", task.name, schedule, task.last_completed);
+                        } else {
+                            out.line("{} - Every {} days - Last performed {}", task.name, task.frequency_days, task.last_completed);
+                        }
+                        break;
+                    case task_type::counter:
+                        out.line("{} - Counter - Last performed {}", task.name, task.last_completed);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        if (has_once_off_tasks) {
+            if (has_repeated_tasks) {
+                out.blank_line();
+            }
+            out.line("Once off tasks: ");
+            for (const auto& task : tasks) {
+                if (task.type == task_type::once_off) {
+                    out.line("{}", task.name);
+                }
+            }
+        }
+    });
+
+    return split_message(message);
+}
+
+std::vector<std::string> render_alert(const std::vector<task_definition>& tasks, std::chrono::sys_days today) {
+    // Determine which tasks are due
+    std::vector<std::pair<const task_definition*, int64_t>> repeated_tasks;
+    std::vector<const task_definition*> one_off_tasks;
+    for (const auto& task : tasks) {
+        switch (task.type) {
+            case task_type::once_off:
+                one_off_tasks.push_back(&task);
+                break;
+            case task_type::regular: {
+                auto next_expected_time = std::chrono::sys_days(task.next_due());
+                if (next_expected_time <= today) {
+                    repeated_tasks.emplace_back(&task, (today - next_expected_time).count());
+                } else if (spdlog::should_log(spdlog::level::debug)) {
+                    // Checked up front as this runs per task, and the dates need converting to log
+                    spdlog::debug("Not alerting: name=\"{}\" last_completed=\"{}\" deadline=\"{}\"", 
+                        task.name, ymd_to_string(task.last_completed), ymd_to_string(std::chrono::year_month_day{ next_expected_time }));
+                }
+                break;
+            }
+            case task_type::counter:
+                break;
+            default:
+                spdlog::warn("Unsupported task type: name=\"{}\"", task.name);
+        }
+    }
+
+    if (repeated_tasks.empty() && one_off_tasks.empty()) {
+        return {};
+    }
+
+    auto message = render_exact([&](message_writer& out) {
+        out.line("You have the following tasks due:");
+        for (const auto& [task, days_late] : repeated_tasks) {
+            if (days_late == 0) {
+                out.line("* {}", task->name);
+            } else {
+                out.line("* {} - {} days late", task->name, days_late);
+            }
+        }
+        if (!one_off_tasks.empty()) {
+            if (!repeated_tasks.empty()) {
+                out.blank_line();
+            }
+            out.line("One-off tasks:");
+            for (const auto* task : one_off_tasks) {
+                out.line("* {}", task->name);
+            }
+        }
+    });
+
+    return split_message(message);
+}
@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <dpp/nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/chrono.h>
+
+#include "choretracker/capture.h"
+#include "choretracker/http_pool.h"
+#include "choretracker/interactions.h"
+#include "choretracker/replay.h"
+
+#define REPLAY_CONNECT_TIMEOUT std::chrono::milliseconds(3000)
+#define REPLAY_READ_TIMEOUT std::chrono::milliseconds(30000)
+// Frequency given to tasks the trace adds, it only changes what they render as
+#define REPLAY_TASK_FREQUENCY 7
+
+/// @brief A trace record rebuilt as a request to the target
+struct replay_request {
+    trace_record record;
+    std::string method;
+    std::string path;
+    std::string body;
+    httplib::Headers headers;
+    std::chrono::steady_clock::time_point due;
+};
+
+struct replay_stats {
+    std::vector<double> captured_ms;
+    std::vector<double> replayed_ms;
+    // Never got a response
+    size_t failed = 0;
+    // Got a different HTTP status than was captured
+    size_t mismatched = 0;
+    // Can't be rebuilt, e.g. OAuth callbacks and websockets
+    size_t skipped = 0;
+};
+
+struct replay_state {
+    Database& db;
+    const replay_options& options;
+    std::unique_ptr<InteractionSigner> signer;
+    HttpClientPool pool;
+    // Random per run, so repeat replays against the same DB don't collide
+    std::string run_id;
+    // Anonymized user to synthetic session cookie, only touched by the scheduling thread
+    std::unordered_map<uint32_t, std::string> sessions;
+    uint64_t sequence = 0;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<replay_request> queue;
+    bool finished = false;
+    std::map<std::string, replay_stats> stats;
+    std::chrono::steady_clock::duration max_lateness{ 0 };
+};
+
+static std::string replay_task_name(uint32_t object) {
+    return std::format("task-{:08x}", object);
+}
+
+static dpp::snowflake replay_user_id(uint32_t user) {
+    // Well clear of real snowflakes, which start from the Discord epoch
+    return dpp::snowflake((1ull << 62) | user);
+}
+
+/// @brief Cookie for a synthetic session standing in for an anonymized user, created on first use
+static std::string replay_session(replay_state& state, uint32_t user) {
+    auto it = state.sessions.find(user);
+    if (it != state.sessions.end()) {
+        return it->second;
+    }
+
+    user_session session;
+    session.user_id = replay_user_id(user).str();
+    session.session_cookie = std::format("replay-{}-{:08x}", state.run_id, user);
+    session.user_name = "replay";
+    session.expires_at = std::chrono::system_clock::now() + REPLAY_SESSION_TTL;
+    if (!state.db.add_session(session)) {
+        spdlog::warn("Could not add replay session: user={:08x}", user);
+    }
+    return state.sessions.emplace(user, session.session_cookie).first->second;
+}
+
+/// @brief Rebuild a web request, or nothing for routes that can't be replayed
+static std::optional<replay_request> build_http_request(replay_state& state, const trace_record& record) {
+    auto space = record.op.find(' ');
+    if (space == std::string::npos) {
+        return {};
+    }
+    auto method = record.op.substr(0, space);
+    auto route = record.op.substr(space + 1);
+
+    // OAuth needs Discord, logout would end the synthetic session, interactions are replayed
+    // from their command records, and the rest have no reproducible content
+    if (route == "/auth/callback" || route == "/auth/logout" || route == "/api/ws" || route == "/api/import" ||
+            route == "/interactions" || route == "<other>") {
+        return {};
+    }
+
+    replay_request request;
+    request.record = record;
+    request.method = method;
+    request.path = route;
+    auto placeholder = route.find("<name>");
+    if (placeholder != std::string::npos) {
+        if (record.object == 0) {
+            return {};
+        }
+        request.path.replace(placeholder, std::strlen("<name>"), replay_task_name(record.object));
+    }
+
+    if (method == "POST" && route == "/api/tasks") {
+        auto task_name = record.object != 0 ? replay_task_name(record.object) : std::format("task-{}-{}", state.run_id, state.sequence);
+        request.body = nlohmann::json{
+            { "task_name", task_name },
+            { "task_frequency", REPLAY_TASK_FREQUENCY },
+            { "task_type", "regular" }
+        }.dump();
+    } else if (method == "PUT" && route == "/api/user/settings") {
+        request.body = nlohmann::json{ { "alert_time", "09:00" }, { "time_zone", "" } }.dump();
+    }
+
+    if (record.user != 0) {
+        request.headers.emplace("Cookie", "session_id=" + replay_session(state, record.user));
+    }
+    return request;
+}
+
+/// @brief Rebuild a slash command or autocomplete as an HTTP interaction
+static std::optional<replay_request> build_interaction(replay_state& state, const trace_record& record) {
+    if (!state.signer) {
+        return {};
+    }
+
+    auto space = record.op.find(' ');
+    auto command_name = record.op.substr(0, space);
+    auto task_name = replay_task_name(record.object);
+
+    auto options = nlohmann::json::array();
+    if (record.kind == trace_kind::autocomplete) {
+        // Size is how much had been typed, which changes how much the name search matches
+        std::string typed = task_name.substr(0, std::min<size_t>(record.size, task_name.size()));
+        options.push_back({ { "type", dpp::co_string }, { "name", "name" }, { "value", typed }, { "focused", true } });
+    } else if (command_name == "addtask" && space != std::string::npos) {
+        auto sub_options = nlohmann::json::array();
+        sub_options.push_back({ { "type", dpp::co_string }, { "name", "name" }, { "value", task_name } });
+        if (record.op.substr(space + 1) == "regular") {
+            sub_options.push_back({ { "type", dpp::co_integer }, { "name", "frequency" }, { "value", REPLAY_TASK_FREQUENCY } });
+        }
+        options.push_back({ { "type", dpp::co_sub_command }, { "name", record.op.substr(space + 1) }, { "options", sub_options } });
+    } else if (command_name == "deletetask" || command_name == "resettask") {
+        options.push_back({ { "type", dpp::co_string }, { "name", "name" }, { "value", task_name } });
+    }
+
+    replay_request request;
+    request.record = record;
+    request.method = "POST";
+    request.path = "/interactions";
+    request.body = nlohmann::json{
+        { "id", std::to_string(state.sequence) },
+        { "application_id", "1" },
+        { "type", record.kind == trace_kind::command ? INTERACTION_TYPE_APPLICATION_COMMAND : INTERACTION_TYPE_AUTOCOMPLETE },
+        { "token", std::format("replay-{}-{}", state.run_id, state.sequence) },
+        { "version", 1 },
+        { "user", { { "id", replay_user_id(record.user).str() }, { "username", "replay" }, { "discriminator", "0" } } },
+        { "data", { { "id", "1" }, { "name", command_name }, { "type", dpp::ctxm_chat_input }, { "options", options } } }
+    }.dump();
+    return request;
+}
+
+/// @brief Send queued requests until the trace is done, timing each one
+static void replay_worker(replay_state& state) {
+    std::unique_lock lock(state.mutex);
+    while (true) {
+        state.cv.wait(lock, [&state]() { return state.finished || !state.queue.empty(); });
+        if (state.queue.empty()) {
+            return;
+        }
+        auto request = std::move(state.queue.front());
+        state.queue.pop_front();
+        lock.unlock();
+
+        auto sent = std::chrono::steady_clock::now();
+        auto headers = request.headers;
+        if (request.record.kind != trace_kind::http) {
+            // Signed as it goes out, like Discord does
+            auto timestamp = std::to_string(std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+            headers.emplace("X-Signature-Timestamp", timestamp);
+            headers.emplace("X-Signature-Ed25519", state.signer->sign(timestamp, request.body));
+        }
+
+        httplib::Result result;
+        {
+            auto client = state.pool.acquire();
+            if (request.method == "GET") {
+                result = client->Get(request.path, headers);
+            } else if (request.method == "POST") {
+                result = client->Post(request.path, headers, request.body, "application/json");
+            } else if (request.method == "PUT") {
+                result = client->Put(request.path, headers, request.body, "application/json");
+            } else if (request.method == "DELETE") {
+                result = client->Delete(request.path, headers);
+            }
+        }
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count();
+
+        lock.lock();
+        auto& stats = state.stats[request.record.op];
+        state.max_lateness = std::max(state.max_lateness, sent - request.due);
+        if (!result) {
+            stats.failed++;
+            continue;
+        }
+        stats.replayed_ms.push_back(elapsed);
+        // Commands only record whether they were handled, so only web statuses can be compared
+        if (request.record.kind == trace_kind::http && result->status != request.record.status) {
+            stats.mismatched++;
+        }
+    }
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(p * (values.size() - 1))];
+}
+
+static void print_summary(replay_state& state) {
+    std::cout << std::format("{:<40} {:>8} {:>8} {:>10} {:>10} {:>10} {:>10} {:>7} {:>10}",
+        "op", "captured", "replayed", "cap p50ms", "cap p99ms", "rep p50ms", "rep p99ms", "failed", "mismatched") << std::endl;
+    for (const auto& [op, stats] : state.stats) {
+        std::cout << std::format("{:<40} {:>8} {:>8} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f} {:>7} {:>10}",
+            op, stats.captured_ms.size(), stats.replayed_ms.size(),
+            percentile(stats.captured_ms, 0.5), percentile(stats.captured_ms, 0.99),
+            percentile(stats.replayed_ms, 0.5), percentile(stats.replayed_ms, 0.99),
+            stats.failed, stats.mismatched) << std::endl;
+    }
+}
+
+int run_replay(Database& db, const replay_options& options) {
+    TraceReader reader(options.trace_path);
+    if (!reader.valid()) {
+        spdlog::error("Not a workload trace: path='{}'", options.trace_path);
+        return 1;
+    }
+
+    replay_state state{ db, options, nullptr, HttpClientPool(options.target, REPLAY_WORKERS, REPLAY_CONNECT_TIMEOUT, REPLAY_READ_TIMEOUT) };
+    std::random_device random;
+    state.run_id = std::format("{:08x}", std::uniform_int_distribution<uint32_t>()(random));
+    if (options.signing_key.has_value()) {
+        state.signer = std::make_unique<InteractionSigner>(options.signing_key.value());
+        if (!state.signer->valid()) {
+            return 1;
+        }
+        spdlog::info("Signing interactions, set the target's interactions_public_key to: {}", state.signer->public_key());
+    } else {
+        spdlog::warn("replay_signing_key not set, slash commands and autocomplete won't be replayed");
+    }
+    spdlog::info("Replaying workload trace: path='{}' captured_at={} target='{}' speed={}",
+        options.trace_path, std::chrono::floor<std::chrono::seconds>(reader.started_at()), options.target, options.speed);
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < REPLAY_WORKERS; i++) {
+        workers.emplace_back(replay_worker, std::ref(state));
+    }
+
+    // Records come out in the order they finished, hold them briefly to send them in the order they started
+    auto later = [](const trace_record& a, const trace_record& b) { return a.offset > b.offset; };
+    std::priority_queue<trace_record, std::vector<trace_record>, decltype(later)> pending(later);
+    std::chrono::microseconds latest_end{ 0 };
+    std::optional<std::chrono::microseconds> first_offset;
+    auto replay_start = std::chrono::steady_clock::now();
+
+    auto dispatch = [&](const trace_record& record) {
+        state.sequence++;
+        if (!first_offset.has_value()) {
+            // Skip any quiet stretch before the first request
+            first_offset = record.offset;
+        }
+
+        auto request = record.kind == trace_kind::http ? build_http_request(state, record) : build_interaction(state, record);
+        if (!request.has_value()) {
+            std::lock_guard lock(state.mutex);
+            state.stats[record.op].skipped++;
+            return;
+        }
+
+        auto offset = std::chrono::duration_cast<std::chrono::steady_clock::duration>((record.offset - first_offset.value()) / options.speed);
+        request->due = replay_start + offset;
+        std::this_thread::sleep_until(request->due);
+        {
+            std::lock_guard lock(state.mutex);
+            state.queue.push_back(std::move(request.value()));
+        }
+        state.cv.notify_one();
+    };
+
+    while (true) {
+        auto record = reader.next();
+        if (record.has_value()) {
+            {
+                std::lock_guard lock(state.mutex);
+                state.stats[record->op].captured_ms.push_back(std::chrono::duration<double, std::milli>(record->duration).count());
+            }
+            // DB calls come from the requests around them, so they're only shown for comparison
+            if (record->kind != trace_kind::db) {
+                latest_end = std::max(latest_end, record->offset + record->duration);
+                pending.push(std::move(record.value()));
+            }
+        }
+
+        while (!pending.empty() && (!record.has_value() || pending.top().offset + REPLAY_REORDER_WINDOW <= latest_end)) {
+            dispatch(pending.top());
+            pending.pop();
+        }
+        if (!record.has_value()) {
+            break;
+        }
+    }
+
+    {
+        std::lock_guard lock(state.mutex);
+        state.finished = true;
+    }
+    state.cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    spdlog::info("Replay finished: elapsed={} max_lateness={}",
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - replay_start),
+        std::chrono::duration_cast<std::chrono::milliseconds>(state.max_lateness));
+    print_summary(state);
+    return 0;
+}
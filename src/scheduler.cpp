@@ -0,0 +1,27 @@
+#include "choretracker/scheduler.h"
+
+void AlertScheduler::schedule(const std::string& user_id, time_point at) {
+    heap.emplace(at, user_id);
+}
+
+std::vector<std::string> AlertScheduler::pop_due(time_point now, size_t max_count) {
+    std::vector<std::string> due;
+    while (!heap.empty() && heap.top().first <= now && due.size() < max_count) {
+        due.push_back(heap.top().second);
+        heap.pop();
+    }
+
+    return due;
+}
+
+std::optional<AlertScheduler::time_point> AlertScheduler::next_due() const {
+    if (heap.empty()) {
+        return {};
+    }
+
+    return heap.top().first;
+}
+
+void AlertScheduler::clear() {
+    heap = {};
+}
@@ -0,0 +1,47 @@
+#include <mutex>
+#include <spdlog/spdlog.h>
+
+#include "choretracker/task_events.h"
+
+uint64_t TaskEventHub::subscribe(const std::string& user_id, subscriber callback) {
+    auto subscription_id = next_subscription_id++;
+
+    std::unique_lock lock(mutex);
+    subscribers[user_id].emplace(subscription_id, std::move(callback));
+
+    return subscription_id;
+}
+
+void TaskEventHub::unsubscribe(const std::string& user_id, uint64_t subscription_id) {
+    // Publishers call back under the shared lock, so this waits out any call in progress
+    std::unique_lock lock(mutex);
+
+    auto it = subscribers.find(user_id);
+    if (it == subscribers.end()) {
+        return;
+    }
+
+    it->second.erase(subscription_id);
+    if (it->second.empty()) {
+        subscribers.erase(it);
+    }
+}
+
+void TaskEventHub::publish(const std::string& user_id, const task_event& event) {
+    auto payload = event.to_json().dump();
+
+    // Callbacks are invoked under the shared lock, so once unsubscribe returns
+    // the subscriber is guaranteed not to be called again. Subscribers must only
+    // queue the payload (e.g. websocket send_text) and never block here.
+    std::shared_lock lock(mutex);
+
+    auto it = subscribers.find(user_id);
+    if (it == subscribers.end()) {
+        return;
+    }
+
+    spdlog::debug("Publishing task event: user_id='{}' subscribers={} payload={}", user_id, it->second.size(), payload);
+    for (const auto& pair : it->second) {
+        pair.second(payload);
+    }
+}
@@ -0,0 +1,112 @@
+#include <string>
+#include <spdlog/spdlog.h>
+
+#include "choretracker/transfer.h"
+
+/// @brief Stored fields of a task, leaving out anything computed
+static nlohmann::json task_to_export_json(const task_definition& task) {
+    nlohmann::json json = {
+        { "owner_user_id", task.owner_user_id.str() },
+        { "name", task.name },
+        { "type", task.type },
+        { "frequency_days", task.frequency_days },
+        { "last_completed", ymd_to_string(task.last_completed) }
+    };
+    if (task.recurrence) {
+        json["recurrence"] = task.recurrence->text();
+    }
+    return json;
+}
+
+static std::optional<task_definition> task_from_export_json(const nlohmann::json& json, const std::optional<dpp::snowflake>& owner) {
+    try {
+        task_definition task;
+        if (owner.has_value()) {
+            task.owner_user_id = owner.value();
+        } else {
+            task.owner_user_id = dpp::snowflake(json.at("owner_user_id").get<std::string>());
+        }
+        task.name = json.at("name").get<std::string>();
+        auto type = json.at("type").get<int32_t>();
+        if (type < task_type::regular || type > task_type::once_off || task.name.empty() || task.owner_user_id.empty()) {
+            return {};
+        }
+        task.type = static_cast<task_type>(type);
+        task.frequency_days = json.value("frequency_days", 0);
+        task.last_completed = parse_ymd(json.at("last_completed").get<std::string>()).value();
+        if (json.contains("recurrence")) {
+            task.recurrence = Recurrence::compile(json.at("recurrence").get<std::string>());
+            if (!task.recurrence) {
+                return {};
+            }
+        }
+
+        return task;
+    } catch (const std::exception&) {
+        return {};
+    }
+}
+
+size_t export_tasks(Database& db, std::ostream& out, const std::optional<dpp::snowflake>& user_id) {
+    size_t exported = 0;
+    db.for_each_task(user_id, [&out, &exported](const task_definition& task) {
+        out << task_to_export_json(task).dump() << '\n';
+        exported++;
+    });
+    out.flush();
+
+    return exported;
+}
+
+bool TaskImporter::add_line(std::string_view line) {
+    // Tolerate CRLF files and trailing blank lines
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+        line.remove_suffix(1);
+    }
+    if (line.empty()) {
+        return true;
+    }
+
+    auto json = nlohmann::json::parse(line, nullptr, false);
+    auto task = json.is_object() ? task_from_export_json(json, owner) : std::nullopt;
+    if (!task.has_value()) {
+        skipped_count++;
+        return false;
+    }
+
+    batch.push_back(std::move(task.value()));
+    if (batch.size() >= IMPORT_BATCH_SIZE) {
+        flush();
+    }
+    return true;
+}
+
+void TaskImporter::finish() {
+    flush();
+    if (skipped_count > 0) {
+        spdlog::warn("Skipped invalid or already existing tasks during import: skipped={}", skipped_count);
+    }
+}
+
+void TaskImporter::flush() {
+    if (batch.empty()) {
+        return;
+    }
+
+    auto inserted = db.insert_tasks(batch);
+    imported_count += inserted;
+    skipped_count += batch.size() - inserted;
+    batch.clear();
+}
+
+TaskImporter import_tasks(Database& db, std::istream& in, const std::optional<dpp::snowflake>& owner) {
+    TaskImporter importer(db, owner);
+
+    std::string line;
+    while (std::getline(in, line)) {
+        importer.add_line(line);
+    }
+    importer.finish();
+
+    return importer;
+}
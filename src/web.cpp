@@ -1,16 +1,45 @@
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <dpp/nlohmann/json.hpp>
 #include <uuid.h>
 
+#include "choretracker/capture.h"
+#include "choretracker/config.h"
+#include "choretracker/metrics.h"
+#include "choretracker/transfer.h"
 #include "choretracker/web.h"
 
 std::string generate_session_token();
+std::string get_cookie_from_header(const std::string& cookie_header, const std::string& name);
+std::string encode_task_cursor(const std::pair<std::string, std::string>& position);
+std::pair<std::string, std::string> decode_task_cursor(const std::string& cursor);
+bool create_private_dir(const std::filesystem::path& path);
+void sweep_export_spool(const std::filesystem::path& spool_dir);
+std::string trace_route(const std::string& url, std::string& task_name);
+std::optional<request_priority> classify_request(const crow::request& req);
+
+// State attached to each task event websocket
+struct ws_subscription {
+    std::string user_id;
+    uint64_t subscription_id;
+};
 
 void Web::init(const std::string& base_url, int port) {
     server.get_middleware<crow::CORSHandler>().global()
         .methods("GET"_method, "POST"_method, "PUT"_method, "DELETE"_method)
         .origin(base_url)
         .allow_credentials();
+    server.get_middleware<RateLimitGuard>().find_session = [this](const std::string& session_cookie) {
+        return find_session(session_cookie);
+    };
 
     /* Static endpoint */
 
@@ -27,6 +56,17 @@ void Web::init(const std::string& base_url, int port) {
         return res;
     });
 
+    // Readiness probe, DrainGuard turns this into a 503 once we start draining
+    CROW_ROUTE(server, "/healthz")
+    ([]() {
+        return crow::response(200, "ok");
+    });
+
+    CROW_ROUTE(server, "/metrics")
+    ([]() {
+        return crow::response(200, "text/plain; version=0.0.4", metrics_render());
+    });
+
     /* Auth endpoints */
 
     CROW_ROUTE(server, "/auth/login")
@@ -49,6 +89,11 @@ void Web::init(const std::string& base_url, int port) {
         return auth_callback(req, code);
     });
 
+    CROW_ROUTE(server, "/auth/logout").methods("POST"_method)
+    ([this](const crow::request& req) {
+        return auth_logout(req);
+    });
+
     /* API endpoints */
 
     CROW_ROUTE(server, "/api/user")
@@ -63,6 +108,40 @@ void Web::init(const std::string& base_url, int port) {
         return user_get(user_session.value());
     });
 
+    CROW_ROUTE(server, "/api/user/settings")
+    ([this](const crow::request& req) {
+        auto user_session = check_auth(req);
+        if (!user_session) {
+            crow::response res(302);
+            res.set_header("Location", "/auth/login");
+            return res;
+        }
+
+        return user_settings_get(user_session.value().user_id);
+    });
+
+    CROW_ROUTE(server, "/api/user/settings").methods("PUT"_method)
+    ([this](const crow::request& req) {
+        auto user_session = check_auth(req);
+        if (!user_session) {
+            crow::response res(302);
+            res.set_header("Location", "/auth/login");
+            return res;
+        }
+
+        std::string alert_time;
+        std::string time_zone;
+        try {
+            auto body_json = nlohmann::json::parse(req.body);
+            alert_time = body_json["alert_time"];
+            time_zone = body_json["time_zone"];
+        } catch (const std::exception&) {
+            return crow::response(400);
+        }
+
+        return user_settings_set(user_session.value().user_id, alert_time, time_zone);
+    });
+
     CROW_ROUTE(server, "/api/tasks")
     ([this](const crow::request& req) {
         auto user_session = check_auth(req);
@@ -72,7 +151,39 @@ void Web::init(const std::string& base_url, int port) {
             return res;
         }
         
-        return tasks_list(user_session.value().user_id);
+        // Optional paging, sorting and projection
+        task_query query;
+        auto limit = req.url_params.get("limit");
+        auto sort = req.url_params.get("sort");
+        auto fields = req.url_params.get("fields");
+        auto cursor = req.url_params.get("cursor");
+        try {
+            if (limit != nullptr) {
+                query.limit = std::clamp(std::stoi(limit), 1, MAX_TASK_PAGE_SIZE);
+            }
+            if (sort != nullptr) {
+                if (std::strcmp(sort, "due") == 0) {
+                    query.sort = task_sort::due;
+                } else if (std::strcmp(sort, "name") != 0) {
+                    return crow::response(400, "Invalid sort");
+                }
+            }
+            if (fields != nullptr) {
+                std::string_view remaining(fields);
+                while (!remaining.empty()) {
+                    auto end = remaining.find(',');
+                    query.fields.emplace_back(remaining.substr(0, end));
+                    remaining = end == std::string_view::npos ? std::string_view() : remaining.substr(end + 1);
+                }
+            }
+            if (cursor != nullptr) {
+                query.after = decode_task_cursor(cursor);
+            }
+        } catch (const std::exception&) {
+            return crow::response(400);
+        }
+
+        return tasks_list(user_session.value().user_id, query);
     });
 
     CROW_ROUTE(server, "/api/tasks").methods("POST"_method)
@@ -87,16 +198,31 @@ void Web::init(const std::string& base_url, int port) {
         std::string task_name;
         int32_t task_frequency;
         task_type task_type;
+        std::shared_ptr<const Recurrence> recurrence;
         try {
             auto body_json = nlohmann::json::parse(req.body);
             task_name = body_json["task_name"];
             task_frequency = body_json["task_frequency"];
             task_type = task_type_from_string(body_json["task_type"]);
+            if (body_json.contains("task_recurrence")) {
+                recurrence = Recurrence::compile(body_json["task_recurrence"].get<std::string>());
+                if (!recurrence) {
+                    return crow::response(400, "Invalid schedule");
+                }
+            }
         } catch (const std::exception&) {
             return crow::response(400);
         }
 
-        return tasks_add(user_session.value().user_id, task_name, task_type, task_frequency);
+        if (recurrence) {
+            task_frequency = recurrence->nominal_days();
+            if (recurrence->kind() == recurrence_kind::interval) {
+                // Plain intervals are what frequency_days already means
+                recurrence.reset();
+            }
+        }
+
+        return tasks_add(user_session.value().user_id, task_name, task_type, task_frequency, recurrence);
     });
 
     CROW_ROUTE(server, "/api/tasks/<string>/complete").methods("PUT"_method)
@@ -112,6 +238,19 @@ void Web::init(const std::string& base_url, int port) {
         return tasks_complete(user_session.value().user_id, decoded_task_name);
     });
 
+    CROW_ROUTE(server, "/api/tasks/<string>/stats")
+    ([this](const crow::request& req, const std::string& task_name) {
+        auto user_session = check_auth(req);
+        if (!user_session) {
+            crow::response res(302);
+            res.set_header("Location", "/auth/login");
+            return res;
+        }
+
+        std::string decoded_task_name = uri_decode(task_name);
+        return tasks_stats(user_session.value().user_id, decoded_task_name);
+    });
+
     CROW_ROUTE(server, "/api/tasks/<string>").methods("DELETE"_method)
     ([this](const crow::request& req, const std::string& task_name) {
         auto user_session = check_auth(req);
@@ -125,33 +264,318 @@ void Web::init(const std::string& base_url, int port) {
         return tasks_delete(user_session.value().user_id, decoded_task_name);
     });
 
+    /* Transfer endpoints */
+
+    CROW_ROUTE(server, "/api/export")
+    ([this](const crow::request& req) {
+        auto user_session = check_auth(req);
+        if (!user_session) {
+            crow::response res(302);
+            res.set_header("Location", "/auth/login");
+            return res;
+        }
+
+        return tasks_export(user_session.value().user_id);
+    });
+
+    CROW_ROUTE(server, "/api/import").methods("POST"_method)
+    ([this](const crow::request& req) {
+        auto user_session = check_auth(req);
+        if (!user_session) {
+            crow::response res(302);
+            res.set_header("Location", "/auth/login");
+            return res;
+        }
+
+        return tasks_import(user_session.value().user_id, req.body);
+    });
+
+    /* Discord interactions endpoint */
+
+    CROW_ROUTE(server, "/interactions").methods("POST"_method)
+    ([this](const crow::request& req, crow::response& res) {
+        interactions_handle(req, res);
+    });
+
+    /* Push endpoints */
+
+    CROW_WEBSOCKET_ROUTE(server, "/api/ws")
+        .onaccept([this](const crow::request& req, void** userdata) {
+            // Middlewares don't run for upgrade requests, so read the cookie directly
+            auto auth_cookie = get_cookie_from_header(req.get_header_value("Cookie"), "session_id");
+            auto user_session = find_session(auth_cookie);
+            if (!user_session) {
+                return false;
+            }
+
+            *userdata = new ws_subscription{ user_session->user_id, 0 };
+            return true;
+        })
+        .onopen([this](crow::websocket::connection& conn) {
+            auto subscription = static_cast<ws_subscription*>(conn.userdata());
+            // Runs on the publisher's thread. The connection outlives it, as onclose unsubscribes (waiting out
+            // any send in progress) before Crow frees the connection, and the write itself is dispatched
+            // onto the connection's own loop
+            subscription->subscription_id = events.subscribe(subscription->user_id, [&conn](const std::string& payload) {
+                conn.dispatch([&conn, payload]() {
+                    conn.send_text(payload);
+                });
+            });
+            spdlog::debug("Task event socket opened: user_id='{}'", subscription->user_id);
+        })
+        .onclose([this](crow::websocket::connection& conn, const std::string& reason, uint16_t) {
+            auto subscription = static_cast<ws_subscription*>(conn.userdata());
+            if (subscription == nullptr) {
+                return;
+            }
+
+            events.unsubscribe(subscription->user_id, subscription->subscription_id);
+            spdlog::debug("Task event socket closed: user_id='{}' reason='{}'", subscription->user_id, reason);
+            conn.userdata(nullptr);
+            delete subscription;
+        });
+
+    // Shutdown signals are handled by main, which drains us before stopping
+    server.signal_clear();
+
     running_future = server.port(port).multithreaded().run_async();
     spdlog::info("Web server started");
 }
 
 Web::~Web() {
+    stop();
+}
+
+/// @brief Turn away new requests, then wait for in-flight ones to finish
+/// @param timeout Longest to wait for in-flight requests
+/// @param grace Least time to keep failing the readiness probe, so the load balancer
+/// stops routing here before the port closes
+void Web::drain(std::chrono::seconds timeout, std::chrono::seconds grace) {
+    auto& guard = server.get_middleware<DrainGuard>();
+    guard.draining = true;
+    spdlog::info("Draining web requests: in_flight={}", guard.in_flight.load());
+
+    auto started = std::chrono::steady_clock::now();
+    auto deadline = started + timeout;
+    while (guard.in_flight > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    if (guard.in_flight > 0) {
+        spdlog::warn("Web drain timed out: in_flight={}", guard.in_flight.load());
+    } else {
+        spdlog::info("Web requests drained");
+    }
+
+    auto ready_after = started + grace;
+    if (std::chrono::steady_clock::now() < ready_after) {
+        spdlog::info("Waiting out the readiness grace period: grace={}", grace);
+        std::this_thread::sleep_until(ready_after);
+    }
+}
+
+void Web::stop() {
+    if (stopped) {
+        return;
+    }
+    stopped = true;
+
     server.stop();
+    if (running_future.valid()) {
+        running_future.wait();
+    }
+    spdlog::info("Web server stopped");
+}
+
+void TraceCapture::before_handle(crow::request& req, crow::response& res, context& ctx) {
+    if (capture_enabled()) {
+        ctx.start = std::chrono::steady_clock::now();
+    }
+}
+
+void TraceCapture::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    if (!capture_enabled() || ctx.start == std::chrono::steady_clock::time_point()) {
+        return;
+    }
+
+    std::string task_name;
+    auto route = trace_route(req.url, task_name);
+    if (req.method == crow::HTTPMethod::Post && route == "/api/tasks") {
+        // New tasks are named in the body, keep it so later completes line up with the add
+        auto body_json = nlohmann::json::parse(req.body, nullptr, false);
+        if (body_json.is_object() && body_json.contains("task_name") && body_json["task_name"].is_string()) {
+            task_name = body_json["task_name"];
+        }
+    }
+    auto user = get_cookie_from_header(req.get_header_value("Cookie"), "session_id");
+    if (user.empty()) {
+        user = "ip:" + req.remote_ip_address;
+    }
+    capture_record(trace_kind::http, std::format("{} {}", crow::method_name(req.method), route), ctx.start,
+        res.code, capture_anonymize(user), capture_anonymize(task_name), res.body.size());
+}
+
+void DrainGuard::before_handle(crow::request& req, crow::response& res, context& ctx) {
+    if (draining) {
+        res.code = 503;
+        res.set_header("Connection", "close");
+        res.set_header("Retry-After", "1");
+        res.end();
+        return;
+    }
+
+    in_flight++;
+    ctx.counted = true;
+}
+
+void DrainGuard::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    if (ctx.counted) {
+        in_flight--;
+        ctx.counted = false;
+    }
+}
+
+void RateLimitGuard::before_handle(crow::request& req, crow::response& res, context& ctx) {
+    // Static pages, probes and the OAuth flow are cheap and shouldn't lock anyone out
+    if (!req.url.starts_with("/api/")) {
+        return;
+    }
+
+    auto config = config_get();
+    auto reject = [&res](std::chrono::milliseconds retry_after) {
+        auto retry_seconds = std::chrono::ceil<std::chrono::seconds>(retry_after);
+        res.code = 429;
+        res.set_header("Retry-After", std::to_string(retry_seconds.count()));
+        res.end();
+    };
+
+    // By address first, so a flood never reaches the session lookup
+    auto retry_after = ip_limiter.acquire(req.remote_ip_address, config->web_rate_limit_per_second * WEB_RATE_LIMIT_IP_MULTIPLIER,
+        config->web_rate_limit_burst * WEB_RATE_LIMIT_IP_MULTIPLIER);
+    if (retry_after.has_value()) {
+        reject(retry_after.value());
+        return;
+    }
+
+    auto session_cookie = get_cookie_from_header(req.get_header_value("Cookie"), "session_id");
+    if (session_cookie.empty() || !find_session) {
+        return;
+    }
+    // Keyed by user, so several sessions share one bucket
+    ctx.session = find_session(session_cookie);
+    ctx.resolved = true;
+    if (ctx.session.has_value()) {
+        retry_after = user_limiter.acquire(ctx.session->user_id, config->web_rate_limit_per_second, config->web_rate_limit_burst);
+        if (retry_after.has_value()) {
+            reject(retry_after.value());
+        }
+    }
+}
+
+/// @brief How important a request is to keep serving when the DB is struggling
+/// @return Priority, or empty for requests that never wait on the DB and are always let through
+std::optional<request_priority> classify_request(const crow::request& req) {
+    // Probes and metrics have to keep working to see what's going on, and websockets
+    // would hold a slot for as long as they're connected
+    if (req.url == "/healthz" || req.url == "/metrics" || req.url == "/api/ws") {
+        return {};
+    }
+
+    // Listings and bulk transfers are the expensive queries, and can be retried later
+    if (req.url == "/api/export" || req.url == "/api/import" ||
+            (req.method == crow::HTTPMethod::Get && req.url.starts_with("/api/tasks"))) {
+        return request_priority::low;
+    }
+    return request_priority::high;
+}
+
+void ConcurrencyGuard::before_handle(crow::request& req, crow::response& res, context& ctx) {
+    auto priority = classify_request(req);
+    if (!priority.has_value()) {
+        return;
+    }
+
+    auto config = config_get();
+    if (!limiter.try_acquire(priority.value(), config->web_concurrency_min, config->web_concurrency_max)) {
+        res.code = 503;
+        res.set_header("Retry-After", "1");
+        res.end();
+        return;
+    }
+
+    ctx.admitted = true;
+    ctx.db_time_at_start = db_thread_time();
+}
+
+void ConcurrencyGuard::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    if (!ctx.admitted) {
+        return;
+    }
+    ctx.admitted = false;
+
+    // Handlers run on the worker thread, so its DB time since the start is this request's.
+    // Requests that never reached the DB don't say anything about its latency
+    std::optional<std::chrono::steady_clock::duration> db_time = db_thread_time() - ctx.db_time_at_start;
+    if (db_time.value() == std::chrono::steady_clock::duration::zero()) {
+        db_time.reset();
+    }
+    auto config = config_get();
+    limiter.release(db_time, config->web_concurrency_min, config->web_concurrency_max);
 }
 
 std::optional<user_session> Web::check_auth(const crow::request& req) {
     auto& cookie_ctx = server.get_context<crow::CookieParser>(req);
     
     auto auth_cookie = cookie_ctx.get_cookie("session_id");
-    if (auth_cookie.empty()) {
+    // API routes already looked the session up for rate limiting
+    auto& rate_limit_ctx = server.get_context<RateLimitGuard>(req);
+    auto user_session = rate_limit_ctx.resolved ? rate_limit_ctx.session : find_session(auth_cookie);
+    if (!user_session.has_value()) {
         return {};
     }
 
-    auto user_session = db.get_session_by_cookie(auth_cookie);
+    // Slide the expiry forward once the session is past half its lifetime
+    auto now = std::chrono::system_clock::now();
+    if (user_session->expires_at - now < SESSION_TTL / 2) {
+        user_session->expires_at = now + SESSION_TTL;
+        if (db.renew_session(auth_cookie, user_session->expires_at)) {
+            set_session_cookie(req, auth_cookie);
+        }
+    }
+
+    return user_session.value();
+}
+
+std::optional<user_session> Web::find_session(const std::string& session_cookie) {
+    if (session_cookie.empty()) {
+        return {};
+    }
+
+    auto user_session = db.get_session_by_cookie(session_cookie);
     if (!user_session.has_value()) {
         return {};
     }
 
-    return user_session.value();
+    // Mongo's TTL monitor only runs periodically, so enforce expiry here too
+    if (user_session->is_expired()) {
+        db.delete_session(session_cookie);
+        return {};
+    }
+
+    return user_session;
 }
 
-crow::response Web::auth_callback(const crow::request& req, const std::string& code) {
+void Web::set_session_cookie(const crow::request& req, const std::string& session_cookie) {
     auto& cookie_ctx = server.get_context<crow::CookieParser>(req);
 
+    cookie_ctx.set_cookie("session_id", session_cookie)
+        .path("/")
+        .max_age(std::chrono::duration_cast<std::chrono::seconds>(SESSION_TTL).count())
+        .same_site(crow::CookieParser::Cookie::SameSitePolicy::Lax)
+        .httponly();
+}
+
+crow::response Web::auth_callback(const crow::request& req, const std::string& code) {
     auto token_resp = oauth.exchange_code_for_token(code);
     if (!token_resp) {
         return crow::response(500);
@@ -167,21 +591,36 @@ crow::response Web::auth_callback(const crow::request& req, const std::string& c
     user_session.user_name = user_info.value()["username"];
     user_session.avatar = user_info.value()["avatar"];
     user_session.session_cookie = generate_session_token();
+    user_session.expires_at = std::chrono::system_clock::now() + SESSION_TTL;
     if (!db.add_session(user_session)) {
         return crow::response(500);
     }
 
-    cookie_ctx.set_cookie("session_id", user_session.session_cookie)
-        .path("/")
-        .max_age(2592000ll) // 30 days
-        .same_site(crow::CookieParser::Cookie::SameSitePolicy::Lax)
-        .httponly();
+    set_session_cookie(req, user_session.session_cookie);
 
     crow::response res(302);
     res.set_header("Location", "/");
     return res;
 }
 
+crow::response Web::auth_logout(const crow::request& req) {
+    auto& cookie_ctx = server.get_context<crow::CookieParser>(req);
+
+    auto auth_cookie = cookie_ctx.get_cookie("session_id");
+    if (!auth_cookie.empty()) {
+        db.delete_session(auth_cookie);
+    }
+
+    // Clear the cookie on the client
+    cookie_ctx.set_cookie("session_id", "")
+        .path("/")
+        .max_age(0)
+        .same_site(crow::CookieParser::Cookie::SameSitePolicy::Lax)
+        .httponly();
+
+    return crow::response(200);
+}
+
 crow::response Web::user_get(const user_session& user_session) {
     auto json_user = user_session.to_json();
     json_user.erase("session_cookie");
@@ -189,66 +628,252 @@ crow::response Web::user_get(const user_session& user_session) {
     return crow::response(200, "application/json", json_user.dump());
 }
 
-crow::response Web::tasks_list(const std::string& user_id) {
-    nlohmann::json resp_json;
-    resp_json["tasks"] =  nlohmann::json::array();
+crow::response Web::user_settings_get(const std::string& user_id) {
+    auto settings = db.get_user_settings(user_id).value_or(user_settings{ user_id });
+
+    return crow::response(200, "application/json", settings.to_json().dump());
+}
+
+crow::response Web::user_settings_set(const std::string& user_id, const std::string& alert_time, const std::string& time_zone) {
+    user_settings settings{ user_id };
+
+    // Alert time is "HH:MM" in the user's time zone
+    unsigned hours, minutes;
+    if (std::sscanf(alert_time.c_str(), "%2u:%2u", &hours, &minutes) != 2 || hours > 23 || minutes > 59) {
+        return crow::response(400, "Invalid alert time");
+    }
+    settings.alert_minutes = hours * 60 + minutes;
+
+    if (!time_zone.empty()) {
+        try {
+            std::chrono::locate_zone(time_zone);
+        } catch (const std::runtime_error&) {
+            return crow::response(400, "Invalid time zone");
+        }
+    }
+    settings.time_zone = time_zone;
+
+    if (db.set_user_settings(settings)) {
+        return crow::response(200, "application/json", settings.to_json().dump());
+    } else {
+        return crow::response(500);
+    }
+}
 
-    for (auto task : db.list_tasks_by_user(user_id)) {
-        resp_json["tasks"].push_back(task.to_json());
+crow::response Web::tasks_list(const std::string& user_id, const task_query& query) {
+    auto page = db.list_tasks_page(user_id, query);
+    if (!page.has_value()) {
+        return crow::response(400);
+    }
+
+    nlohmann::json resp_json;
+    resp_json["tasks"] = std::move(page->tasks);
+    if (page->next.has_value()) {
+        resp_json["next_cursor"] = encode_task_cursor(page->next.value());
+    } else {
+        resp_json["next_cursor"] = nullptr;
     }
 
     return crow::response(200, "application/json", resp_json.dump());
 }
 
-crow::response Web::tasks_add(const std::string& user_id, const std::string& task_name, task_type task_type, int32_t task_frequency) {
+crow::response Web::tasks_add(const std::string& user_id, const std::string& task_name, task_type task_type, int32_t task_frequency,
+        std::shared_ptr<const Recurrence> recurrence) {
     task_definition task;
     task.owner_user_id = user_id;
     task.name = task_name;
     task.type = task_type;
     task.last_completed = get_today_as_ymd();
     task.frequency_days = task_frequency;
-
-    if (db.add_task(task)) {
-        return crow::response(200, "application/json", task.to_json().dump());
-    } else {
-        return crow::response(400, "Already exists");
+    task.recurrence = std::move(recurrence);
+
+    switch (writer.add_task(task)) {
+        case write_result::applied:
+            events.publish(user_id, { task_event_action::added, task_name });
+            return crow::response(200, "application/json", task.to_json().dump());
+        case write_result::queued:
+            // Mongo is unavailable, it's saved locally and will be added once it's back
+            return crow::response(202, "application/json", task.to_json().dump());
+        default:
+            return crow::response(400, "Already exists");
     }
 }
 
 crow::response Web::tasks_delete(const std::string& user_id, const std::string& task_name) {
-    if (db.delete_task(user_id, task_name)) {
-        return crow::response(200);
-    } else {
-        return crow::response(404, "Not found");
+    switch (writer.delete_task(user_id, task_name)) {
+        case write_result::applied:
+            events.publish(user_id, { task_event_action::deleted, task_name });
+            return crow::response(200);
+        case write_result::queued:
+            return crow::response(202);
+        default:
+            return crow::response(404, "Not found");
     }
 }
 
 crow::response Web::tasks_complete(const std::string& user_id, const std::string& task_name) {
-    // First, find the task to check if it's a once-off task
-    auto tasks = db.list_tasks_by_user(user_id);
-    auto task_it = std::find_if(tasks.begin(), tasks.end(), 
-        [&task_name](const task_definition& task) {
-            return task.name == task_name;
-        });
-    
-    if (task_it == tasks.end()) {
-        return crow::response(404, "Not found");
-    }
-    
-    // If it's a once-off task, delete it instead of completing it
-    if (task_it->type == task_type::once_off) {
-        if (db.delete_task(user_id, task_name)) {
+    // Once-off tasks are deleted rather than completed, the writer takes care of that
+    switch (writer.complete_task(user_id, task_name)) {
+        case write_result::applied:
+            events.publish(user_id, { task_event_action::completed, task_name });
             return crow::response(200);
-        } else {
-            return crow::response(500, "Failed to complete once-off task");
+        case write_result::queued:
+            return crow::response(202);
+        default:
+            return crow::response(404, "Not found");
+    }
+}
+
+crow::response Web::tasks_export(const std::string& user_id) {
+    // Spool to disk from the DB cursor, then let Crow stream the file out in chunks,
+    // so memory stays flat no matter how many tasks there are
+    // Exports hold users' tasks, so only this process's user can get into the spool dir
+    std::error_code ec;
+    auto spool_dir = std::filesystem::temp_directory_path(ec) / std::format("{}-{}", EXPORT_SPOOL_DIR, ::geteuid());
+    if (ec || !create_private_dir(spool_dir)) {
+        spdlog::error("Failed to create export spool dir: path='{}'", spool_dir.string());
+        return crow::response(500);
+    }
+    sweep_export_spool(spool_dir);
+
+    auto spool_path = spool_dir / (generate_session_token() + ".ndjson");
+    {
+        std::ofstream out(spool_path, std::ios::binary);
+        auto exported = export_tasks(db, out, dpp::snowflake(user_id));
+        if (!out) {
+            spdlog::error("Failed to write export spool: path='{}'", spool_path.string());
+            return crow::response(500);
         }
+        spdlog::info("Tasks exported: user_id='{}' count={}", user_id, exported);
+    }
+
+    crow::response res;
+    res.set_static_file_info_unsafe(spool_path.string());
+    res.set_header("Content-Type", "application/x-ndjson");
+    res.set_header("Content-Disposition", "attachment; filename=\"tasks.ndjson\"");
+    return res;
+}
+
+crow::response Web::tasks_import(const std::string& user_id, const std::string& body) {
+    // Everything is imported as the signed in user, whatever the file says
+    TaskImporter importer(db, dpp::snowflake(user_id));
+    std::string_view remaining(body);
+    while (!remaining.empty()) {
+        auto end = remaining.find('\n');
+        importer.add_line(remaining.substr(0, end));
+        remaining = end == std::string_view::npos ? std::string_view() : remaining.substr(end + 1);
+    }
+    importer.finish();
+
+    if (importer.imported() > 0) {
+        events.publish(user_id, { task_event_action::imported, "" });
+    }
+    spdlog::info("Tasks imported: user_id='{}' imported={} skipped={}", user_id, importer.imported(), importer.skipped());
+
+    nlohmann::json resp_json = {
+        { "imported", importer.imported() },
+        { "skipped", importer.skipped() }
+    };
+    return crow::response(200, "application/json", resp_json.dump());
+}
+
+crow::response Web::tasks_stats(const std::string& user_id, const std::string& task_name) {
+    // Totals come straight from the per-month buckets, no raw events are scanned
+    auto buckets = db.list_completion_buckets(user_id, task_name);
+
+    int64_t total_completions = 0;
+    int64_t interval_sum_days = 0;
+    int64_t interval_count = 0;
+    nlohmann::json months = nlohmann::json::array();
+    for (const auto& bucket : buckets) {
+        total_completions += bucket.count;
+        interval_sum_days += bucket.interval_sum_days;
+        interval_count += bucket.interval_count;
+        months.push_back(bucket.to_json());
+    }
+
+    nlohmann::json resp_json = {
+        { "name", task_name },
+        { "total_completions", total_completions },
+        { "months", months }
+    };
+    if (interval_count > 0) {
+        resp_json["average_interval_days"] = static_cast<double>(interval_sum_days) / interval_count;
     } else {
-        // For regular and counter tasks, just update the completion date
-        if (db.complete_task(user_id, task_name)) {
-            return crow::response(200);
-        } else {
-            return crow::response(404, "Not found");
+        resp_json["average_interval_days"] = nullptr;
+    }
+    if (!buckets.empty()) {
+        resp_json["first_completed"] = ymd_to_string(buckets.front().first_completed);
+        resp_json["last_completed"] = ymd_to_string(buckets.back().last_completed);
+    }
+
+    return crow::response(200, "application/json", resp_json.dump());
+}
+
+/// @brief Handle an interaction delivered by Discord over HTTP rather than the gateway
+///
+/// Each request is verified and answered on its own, so any number of web replicas
+/// can sit behind the interactions endpoint URL.
+void Web::interactions_handle(const crow::request& req, crow::response& res) {
+    if (!interactions || !bot) {
+        res.code = 404;
+        res.end();
+        return;
+    }
+
+    if (!interactions->verify(req.get_header_value("X-Signature-Timestamp"), req.body, req.get_header_value("X-Signature-Ed25519"))) {
+        res.code = 401;
+        res.end("Invalid request signature");
+        return;
+    }
+
+    nlohmann::json body;
+    dpp::interaction command;
+    try {
+        body = nlohmann::json::parse(req.body);
+        if (body.value("type", 0) != INTERACTION_TYPE_PING) {
+            command.fill_from_json(&body);
         }
+    } catch (const std::exception&) {
+        res.code = 400;
+        res.end();
+        return;
+    }
+
+    res.set_header("Content-Type", "application/json");
+    switch (body.value("type", 0)) {
+        case INTERACTION_TYPE_PING:
+            res.end(nlohmann::json({ { "type", INTERACTION_TYPE_PING } }).dump());
+            break;
+        case INTERACTION_TYPE_AUTOCOMPLETE: {
+            auto response = bot->handle_autocomplete(command).value_or(dpp::interaction_response(dpp::ir_autocomplete_reply));
+            res.end(response.build_json());
+            break;
+        }
+        case INTERACTION_TYPE_APPLICATION_COMMAND: {
+            bool responded = false;
+            bot->handle_command(command, [this, &res, &responded, &command](const dpp::message& message, const std::function<void()>& on_sent) {
+                responded = true;
+                if (!on_sent) {
+                    res.end(dpp::interaction_response(dpp::ir_channel_message_with_source, message).build_json());
+                    return;
+                }
+                // Follow-ups only work once Discord has the reply, which isn't until after this response
+                // is written. So acknowledge now, fill the reply in over REST and follow up from there
+                res.end(dpp::interaction_response(dpp::ir_deferred_channel_message_with_source,
+                    dpp::message().set_flags(message.flags)).build_json());
+                bot->send_deferred_reply(command.application_id, command.token, message, on_sent);
+            });
+            if (!responded) {
+                res.code = 400;
+                res.end();
+            }
+            break;
+        }
+        default:
+            res.code = 400;
+            res.end();
+            break;
     }
 }
 
@@ -261,4 +886,100 @@ std::string generate_session_token() {
     uuids::uuid_random_generator gen{generator};
 
     return uuids::to_string(gen());
-}
\ No newline at end of file
+}
+
+std::string get_cookie_from_header(const std::string& cookie_header, const std::string& name) {
+    std::string_view remaining(cookie_header);
+
+    while (!remaining.empty()) {
+        auto end = remaining.find(';');
+        auto pair = remaining.substr(0, end);
+        remaining = end == std::string_view::npos ? std::string_view() : remaining.substr(end + 1);
+
+        // Trim leading whitespace left over from the separator
+        auto start = pair.find_first_not_of(' ');
+        if (start == std::string_view::npos) {
+            continue;
+        }
+        pair = pair.substr(start);
+
+        auto eq = pair.find('=');
+        if (eq != std::string_view::npos && pair.substr(0, eq) == name) {
+            return std::string(pair.substr(eq + 1));
+        }
+    }
+
+    return {};
+}
+
+/// @brief Encode a listing position as an opaque, URL-safe cursor
+std::string encode_task_cursor(const std::pair<std::string, std::string>& position) {
+    return crow::utility::base64encode_urlsafe(position.first + '\n' + position.second, position.first.size() + 1 + position.second.size());
+}
+
+std::pair<std::string, std::string> decode_task_cursor(const std::string& cursor) {
+    auto decoded = crow::utility::base64decode(cursor, cursor.size());
+    auto split = decoded.rfind('\n');
+    if (split == std::string::npos) {
+        throw std::invalid_argument("Invalid cursor");
+    }
+
+    return { decoded.substr(0, split), decoded.substr(split + 1) };
+}
+
+/// @brief Create a directory only its owner can use, or check an existing one is exactly that
+/// @return Whether the directory is ours and private, so nothing in it can be read or swapped out by other users
+bool create_private_dir(const std::filesystem::path& path) {
+    if (::mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+    // Anyone can create it first in a shared temp dir, so don't trust one we didn't make
+    struct stat info;
+    if (::lstat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    return S_ISDIR(info.st_mode) && info.st_uid == ::geteuid() && (info.st_mode & 077) == 0;
+}
+
+/// @brief Remove export spool files old enough to have finished sending
+void sweep_export_spool(const std::filesystem::path& spool_dir) {
+    std::error_code ec;
+    auto cutoff = std::filesystem::file_time_type::clock::now() - EXPORT_SPOOL_TTL;
+    for (const auto& entry : std::filesystem::directory_iterator(spool_dir, ec)) {
+        if (entry.is_regular_file(ec) && entry.last_write_time(ec) < cutoff) {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+}
+
+/// @brief Reduce a request path to its route, so traces hold no task names or probe junk
+/// @param url Request path, without the query string
+/// @param task_name Set to the decoded task name if the route has one
+std::string trace_route(const std::string& url, std::string& task_name) {
+    static const std::set<std::string> routes = {
+        "/", "/healthz", "/metrics", "/auth/login", "/auth/callback", "/auth/logout", "/api/user",
+        "/api/user/settings", "/api/tasks", "/api/export", "/api/import", "/interactions", "/api/ws"
+    };
+    if (routes.contains(url)) {
+        return url;
+    }
+
+    std::string_view prefix = "/api/tasks/";
+    if (!url.starts_with(prefix)) {
+        return "<other>";
+    }
+    std::string_view rest(url);
+    rest.remove_prefix(prefix.size());
+    auto slash = rest.find('/');
+    task_name = uri_decode(rest.substr(0, slash));
+    if (slash == std::string_view::npos) {
+        return "/api/tasks/<name>";
+    }
+
+    auto action = rest.substr(slash);
+    if (action == "/complete" || action == "/stats") {
+        return std::format("/api/tasks/<name>{}", action);
+    }
+    task_name.clear();
+    return "<other>";
+}
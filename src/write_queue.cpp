@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <format>
+#include <fstream>
+#include <unistd.h>
+#include <vector>
+#include <mongocxx/exception/exception.hpp>
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/chrono.h>
+#include <uuid.h>
+
+#include "choretracker/write_queue.h"
+
+#define SEGMENT_PREFIX "segment-"
+#define SEGMENT_SUFFIX ".log"
+#define CHECKPOINT_FILE "checkpoint"
+// Queued writes Mongo refused outright, kept for someone to look at
+#define DEAD_LETTER_FILE "dead-letter.log"
+
+/// @brief Segment files in sequence order, named by the first sequence number they hold
+static std::vector<std::pair<uint64_t, std::filesystem::path>> list_segments(const std::filesystem::path& directory) {
+    std::vector<std::pair<uint64_t, std::filesystem::path>> segments;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        auto name = entry.path().filename().string();
+        if (!name.starts_with(SEGMENT_PREFIX) || !name.ends_with(SEGMENT_SUFFIX)) {
+            continue;
+        }
+        try {
+            segments.emplace_back(std::stoull(name.substr(std::strlen(SEGMENT_PREFIX))), entry.path());
+        } catch (const std::exception&) {
+            continue;
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+/// @brief Write all of a buffer, then flush it to disk
+static bool write_durable(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        auto result = ::write(fd, data.data() + written, data.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += result;
+    }
+    return ::fdatasync(fd) == 0;
+}
+
+TaskWriter::TaskWriter(Database& db, TaskEventHub& events, const std::filesystem::path& directory)
+    : db(db), events(events), directory(directory), generator(std::random_device{}()),
+    depth(metrics_gauge("write_queue_depth", "Task writes waiting to be replayed to Mongo")),
+    lag_seconds(metrics_gauge("write_queue_lag_seconds", "Age of the oldest task write waiting to be replayed")),
+    queued_total(metrics_counter("write_queue_queued_total", "Task writes saved to the local queue")),
+    replayed_total(metrics_counter("write_queue_replayed_total", "Queued task writes replayed to Mongo")),
+    replay_failures_total(metrics_counter("write_queue_replay_failures_total", "Replay attempts that failed and will be retried")),
+    dead_lettered_total(metrics_counter("write_queue_dead_lettered_total", "Queued task writes Mongo refused, set aside in the dead letter file")) {
+    std::filesystem::create_directories(directory);
+    // Another process replaying the same segments could delete ones this one hasn't replayed yet
+    lock_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (lock_fd < 0) {
+        throw std::runtime_error(std::format("Unable to open write queue directory: {}", std::strerror(errno)));
+    }
+    if (::flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        ::close(lock_fd);
+        throw std::runtime_error(std::format("Write queue directory is in use by another process, each needs its own write_queue_dir: dir='{}'",
+            directory.string()));
+    }
+    recover();
+    thread = std::thread(&TaskWriter::thread_task, this);
+}
+
+TaskWriter::~TaskWriter() {
+    stop();
+    ::close(lock_fd);
+}
+
+void TaskWriter::stop() {
+    {
+        std::lock_guard lock(mutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    cv.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    if (segment_fd >= 0) {
+        ::close(segment_fd);
+        segment_fd = -1;
+    }
+    if (!pending.empty()) {
+        spdlog::warn("Task writes left queued for next start: pending={}", pending.size());
+    }
+}
+
+write_result TaskWriter::add_task(const task_definition& task) {
+    task_mutation mutation{};
+    mutation.type = task_mutation_type::add;
+    mutation.task = task;
+    return submit(std::move(mutation));
+}
+
+write_result TaskWriter::complete_task(const dpp::snowflake& user_id, const std::string& task_name) {
+    task_mutation mutation{};
+    mutation.type = task_mutation_type::complete;
+    mutation.task.owner_user_id = user_id;
+    mutation.task.name = task_name;
+    mutation.completed_on = get_today_as_ymd();
+    return submit(std::move(mutation));
+}
+
+write_result TaskWriter::delete_task(const dpp::snowflake& user_id, const std::string& task_name) {
+    task_mutation mutation{};
+    mutation.type = task_mutation_type::remove;
+    mutation.task.owner_user_id = user_id;
+    mutation.task.name = task_name;
+    return submit(std::move(mutation));
+}
+
+write_result TaskWriter::submit(task_mutation mutation) {
+    mutation.accepted_at = std::chrono::system_clock::now();
+
+    std::unique_lock lock(mutex);
+    uuids::uuid_random_generator uuid_generator{ generator };
+    mutation.idempotency_key = uuids::to_string(uuid_generator());
+
+    // Go straight to Mongo unless earlier writes are still waiting, which keeps writes in order
+    if (healthy && pending.empty()) {
+        lock.unlock();
+        try {
+            return db.apply_mutation(mutation) ? write_result::applied : write_result::rejected;
+        } catch (const mongocxx::exception& e) {
+            // Only an outage is worth queueing, a write Mongo refuses would be refused again on replay
+            if (!db_is_unavailable(e)) {
+                spdlog::warn("Task write rejected: error='{}'", e.what());
+                return write_result::rejected;
+            }
+            spdlog::warn("Task write failed, queueing locally: error='{}'", e.what());
+        }
+        lock.lock();
+        healthy = false;
+    }
+
+    append(mutation);
+    return write_result::queued;
+}
+
+/// @brief Persist a mutation to the current segment and queue it for replay, mutex must be held
+void TaskWriter::append(task_mutation& mutation) {
+    mutation.sequence = next_sequence++;
+
+    if (segment_fd < 0 || segment_size >= WRITE_QUEUE_SEGMENT_BYTES) {
+        if (segment_fd >= 0) {
+            ::close(segment_fd);
+        }
+        auto path = directory / std::format("{}{:020}{}", SEGMENT_PREFIX, mutation.sequence, SEGMENT_SUFFIX);
+        segment_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        segment_size = 0;
+        if (segment_fd < 0) {
+            throw std::runtime_error(std::format("Unable to open write queue segment: {}", std::strerror(errno)));
+        }
+    }
+
+    auto line = mutation.to_json().dump() + '\n';
+    if (!write_durable(segment_fd, line)) {
+        throw std::runtime_error(std::format("Unable to write to write queue segment: {}", std::strerror(errno)));
+    }
+    segment_size += line.size();
+
+    pending.push_back(mutation);
+    queued_total.inc();
+    depth.set(pending.size());
+    update_lag();
+    cv.notify_one();
+}
+
+/// @brief Load anything not yet replayed from a previous run
+void TaskWriter::recover() {
+    uint64_t checkpoint = 0;
+    std::ifstream checkpoint_file(directory / CHECKPOINT_FILE);
+    checkpoint_file >> checkpoint;
+    next_sequence = checkpoint + 1;
+
+    auto segments = list_segments(directory);
+    for (size_t i = 0; i < segments.size(); i++) {
+        const auto& path = segments[i].second;
+        std::ifstream segment(path);
+        std::string line;
+        uint64_t readable_bytes = 0;
+        while (std::getline(segment, line)) {
+            auto json = nlohmann::json::parse(line, nullptr, false);
+            auto mutation = json.is_discarded() ? std::nullopt : task_mutation::from_json(json);
+            if (!mutation.has_value()) {
+                // A crash mid-append can only tear the very last line, which was never acknowledged.
+                // Anything else was, so stop rather than drop it
+                bool torn_tail = i + 1 == segments.size() && segment.peek() == std::char_traits<char>::eof();
+                if (!torn_tail) {
+                    throw std::runtime_error(std::format("Write queue segment is corrupt: segment='{}' offset={}",
+                        path.string(), readable_bytes));
+                }
+                spdlog::warn("Dropping torn write queue entry: segment='{}' offset={}", path.string(), readable_bytes);
+                // Cut it off, as later writes go to a new segment and would leave it mid-queue
+                segment.close();
+                std::filesystem::resize_file(path, readable_bytes);
+                break;
+            }
+            readable_bytes += line.size() + 1;
+
+            next_sequence = std::max(next_sequence, mutation->sequence + 1);
+            if (mutation->sequence > checkpoint) {
+                pending.push_back(std::move(mutation.value()));
+            }
+        }
+    }
+
+    if (!pending.empty()) {
+        healthy = false;
+        spdlog::info("Recovered queued task writes: pending={}", pending.size());
+    }
+    depth.set(pending.size());
+    update_lag();
+}
+
+/// @brief Record the last replayed sequence number, replacing the file atomically
+void TaskWriter::write_checkpoint(uint64_t sequence) {
+    auto temp_path = directory / (CHECKPOINT_FILE ".tmp");
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        spdlog::error("Unable to write write queue checkpoint: {}", std::strerror(errno));
+        return;
+    }
+    bool written = write_durable(fd, std::to_string(sequence));
+    ::close(fd);
+
+    std::error_code ec;
+    if (written) {
+        std::filesystem::rename(temp_path, directory / CHECKPOINT_FILE, ec);
+    }
+    if (!written || ec) {
+        spdlog::error("Unable to write write queue checkpoint: sequence={}", sequence);
+    }
+}
+
+/// @brief Set aside a queued write Mongo refused, so replay can move past it
+void TaskWriter::dead_letter(const task_mutation& mutation, const std::string& error) {
+    auto entry = mutation.to_json();
+    entry["error"] = error;
+    auto line = entry.dump() + '\n';
+
+    int fd = ::open((directory / DEAD_LETTER_FILE).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0 || !write_durable(fd, line)) {
+        spdlog::error("Unable to write to write queue dead letter file, dropping: sequence={} entry='{}'", mutation.sequence, line);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    dead_lettered_total.inc();
+}
+
+/// @brief Delete segments whose writes have all been replayed, mutex must be held
+void TaskWriter::remove_replayed_segments(uint64_t sequence) {
+    auto segments = list_segments(directory);
+    if (pending.empty()) {
+        // Everything is replayed, start afresh with the next write
+        if (segment_fd >= 0) {
+            ::close(segment_fd);
+            segment_fd = -1;
+        }
+        for (const auto& segment : segments) {
+            std::filesystem::remove(segment.second);
+        }
+        return;
+    }
+
+    // A segment is done once the one after it starts at or before the next write to replay
+    for (size_t i = 0; i + 1 < segments.size(); i++) {
+        if (segments[i + 1].first <= sequence + 1) {
+            std::filesystem::remove(segments[i].second);
+        }
+    }
+}
+
+/// @brief Publish how far behind replay is, mutex must be held
+void TaskWriter::update_lag() {
+    if (pending.empty()) {
+        lag_seconds.set(0);
+        return;
+    }
+    auto lag = std::chrono::system_clock::now() - pending.front().accepted_at;
+    lag_seconds.set(std::chrono::duration_cast<std::chrono::seconds>(lag).count());
+}
+
+void TaskWriter::thread_task() {
+    std::unique_lock lock(mutex);
+    while (!stopping) {
+        if (pending.empty()) {
+            cv.wait(lock, [this]() { return stopping || !pending.empty(); });
+            continue;
+        }
+
+        auto mutation = pending.front();
+        lock.unlock();
+
+        bool replayed = false;
+        bool applied = false;
+        try {
+            applied = db.apply_mutation(mutation);
+            replayed = true;
+        } catch (const std::exception& e) {
+            if (db_is_unavailable(e)) {
+                spdlog::debug("Task write replay failed, retrying: sequence={} error='{}'", mutation.sequence, e.what());
+            } else {
+                // Retrying would fail the same way and hold up every write queued after it
+                spdlog::error("Task write replay refused, dead lettering it: sequence={} error='{}'", mutation.sequence, e.what());
+                dead_letter(mutation, e.what());
+                replayed = true;
+            }
+        }
+
+        lock.lock();
+        if (!replayed) {
+            replay_failures_total.inc();
+            update_lag();
+            cv.wait_for(lock, WRITE_QUEUE_RETRY_INTERVAL, [this]() { return stopping; });
+            continue;
+        }
+
+        pending.pop_front();
+        replayed_total.inc();
+        write_checkpoint(mutation.sequence);
+        remove_replayed_segments(mutation.sequence);
+        depth.set(pending.size());
+        auto lag = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - mutation.accepted_at);
+        update_lag();
+        if (pending.empty()) {
+            healthy = true;
+            spdlog::info("Queued task writes replayed: last_sequence={} lag={}", mutation.sequence, lag);
+        }
+        lock.unlock();
+
+        if (applied) {
+            auto action = task_event_action::added;
+            if (mutation.type == task_mutation_type::complete) {
+                action = task_event_action::completed;
+            } else if (mutation.type == task_mutation_type::remove) {
+                action = task_event_action::deleted;
+            }
+            events.publish(mutation.task.owner_user_id.str(), { action, mutation.task.name });
+        }
+        lock.lock();
+    }
+}